@@ -0,0 +1,293 @@
+// Marc B. Reynolds, 2022-2025
+// Public Domain under http://unlicense.org, see link for details.
+
+// Microbenchmark of the registered bit finalizers. Each is measured
+// in three ways:
+// 1) latency:    dependent chain x = f(x)
+// 2) throughput: independent inputs (a counter) with results folded
+// 3) batch:      the batch version over a generator sized buffer
+//
+// Scalar modes call through the function pointer (as the driver does
+// for scalar use) so include the call overhead. Each measurement is
+// repeated and reported as mean with a 95% confidence interval. Cycles
+// are TSC ticks (reference cycles) so don't track turbo/throttling.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "mini_testu01.h"
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+static inline uint64_t get_ticks(void) { return __rdtsc(); }
+#else
+static inline uint64_t get_ticks(void) { return 0; }
+#endif
+
+//*****************************************************************************
+
+enum { mode_latency, mode_throughput, mode_batch, mode_length };
+
+static char* mode_name[] = {
+  [mode_latency]    = "latency",
+  [mode_throughput] = "throughput",
+  [mode_batch]      = "batch",
+};
+
+#define BENCH_BATCH_LEN 1024
+#define BENCH_MAX_REPS  256
+
+uint64_t bench_buffer[BENCH_BATCH_LEN];
+
+uint32_t reps  = 11;
+uint64_t count = UINT64_C(1) << 20;    // hashes per repetition
+uint64_t sink  = 0;
+
+static uint64_t run_latency(hash_t* f, uint64_t n)
+{
+  uint64_t x = hint_no_const_fold_64(sink);
+
+  for(uint64_t i=0; i<n; i++)
+    x = f(x);
+
+  return x;
+}
+
+static uint64_t run_throughput(hash_t* f, uint64_t n)
+{
+  uint64_t r = 0;
+  uint64_t c = hint_no_const_fold_64(sink);
+
+  for(uint64_t i=0; i<n; i++)
+    r ^= f(c+i);
+
+  return r;
+}
+
+static uint64_t run_batch(hash_batch_t* b, uint64_t n)
+{
+  uint64_t* buf = bench_buffer;
+  uint64_t  c   = hint_no_const_fold_64(sink);
+  uint64_t  r   = 0;
+
+  for(uint64_t i=0; i<n; i+=BENCH_BATCH_LEN) {
+    for(uint32_t j=0; j<BENCH_BATCH_LEN; j++) buf[j] = c++;
+    b(buf, buf, BENCH_BATCH_LEN);
+    r ^= buf[BENCH_BATCH_LEN-1];
+  }
+
+  return r;
+}
+
+//*****************************************************************************
+
+typedef struct {
+  double mean;
+  double ci;        // half-width of the 95% interval
+  double min;
+} stat_t;
+
+// two-sided 95% Student's t for 'df' degrees of freedom
+static double t95(uint32_t df)
+{
+  static const double t[] = {
+    0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+
+  return (df < LENGTHOF(t)) ? t[df] : 1.960;
+}
+
+static void stat_compute(stat_t* s, const double* v, uint32_t n)
+{
+  double sum = 0.0, sum2 = 0.0, min = v[0];
+
+  for(uint32_t i=0; i<n; i++) {
+    sum += v[i];
+    min  = fmin(min, v[i]);
+  }
+
+  s->mean = sum/n;
+
+  for(uint32_t i=0; i<n; i++) {
+    double d = v[i]-s->mean;
+    sum2 += d*d;
+  }
+
+  s->min = min;
+  s->ci  = (n > 1) ? t95(n-1)*sqrt(sum2/(n-1))/sqrt((double)n) : 0.0;
+}
+
+static void bench(const char* name, hash_t* f, hash_batch_t* b)
+{
+  double ns[BENCH_MAX_REPS];
+  double cy[BENCH_MAX_REPS];
+
+  bit_finalizer = f;     // for generic batch
+
+  for(uint32_t m=0; m<mode_length; m++) {
+    stat_t sn, sc;
+
+    // one untimed warm-up pass then the timed repetitions
+    for(int32_t r=-1; r<(int32_t)reps; r++) {
+      uint64_t t0 = get_timestamp();
+      uint64_t c0 = get_ticks();
+      uint64_t v;
+
+      switch(m) {
+      case mode_latency:    v = run_latency(f, count);    break;
+      case mode_throughput: v = run_throughput(f, count); break;
+      default:              v = run_batch(b, count);      break;
+      }
+
+      uint64_t c1 = get_ticks();
+      uint64_t t1 = get_timestamp();
+
+      hint_result_barrier(v);
+      sink ^= v;
+
+      if (r < 0) continue;
+
+      ns[r] = (double)(t1-t0)/(double)count;
+      cy[r] = (double)(c1-c0)/(double)count;
+    }
+
+    stat_compute(&sn, ns, reps);
+    stat_compute(&sc, cy, reps);
+
+    printf("%-20s %-11s %8.3f ± %6.3f  (min %8.3f)  %8.2f ± %6.2f\n",
+	   (m == 0) ? name : "", mode_name[m],
+	   sn.mean, sn.ci, sn.min, sc.mean, sc.ci);
+  }
+}
+
+//*****************************************************************************
+
+void help_options(char* name)
+{
+  printf("Usage: %s [OPTIONS]\n", name);
+  printf("\n"
+	 "    --hash=NAME      only the named function (default is all)\n"
+	 "    --xsm3=S0,M0,S1,M1,S2\n"
+	 "                     runtime parameter xorshift_mul_3 (only it unless\n"
+	 "                     --hash is also given)\n"
+	 "    --jit=SPEC       compiled at runtime (see mini_testu01), same rule\n"
+	 "    --plugin=PATH    finalizer of a plugin (see plugin.h), same rule\n"
+	 "    --compose=SPEC   stage list (see mini_testu01), same rule\n"
+	 "    --reps=VALUE     timed repetitions (default 11)\n"
+	 "    --count=VALUE    hashes per repetition (default 2^20)\n"
+	 "    --help           \n"
+	 "\n");
+
+  exit(0);
+}
+
+int main(int argc, char** argv)
+{
+  static struct option long_options[] = {
+    {"hash",       required_argument, 0, 'h'},
+    {"reps",       required_argument, 0, 'r'},
+    {"count",      required_argument, 0, 'n'},
+    {"xsm3",       required_argument, 0, 'x'},
+    {"jit",        required_argument, 0, 'j'},
+    {"plugin",     required_argument, 0, 'p'},
+    {"compose",    required_argument, 0, 'c'},
+    {"help",       optional_argument, 0, '?'},
+    {0,            0,                 0,  0 }
+  };
+
+  char* only = NULL;
+  char* xsm3 = NULL;
+  char* jit  = NULL;
+  char* plug = NULL;
+  char* comp = NULL;
+  int   c;
+
+  while (1) {
+    int option_index = 0;
+
+    c = getopt_long(argc, argv, "", long_options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 'h': only  = optarg; break;
+    case 'r': reps  = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 'n': count = strtoul(optarg, NULL, 0); break;
+    case 'x': xsm3  = optarg; break;
+    case 'j': jit   = optarg; break;
+    case 'p': plug  = optarg; break;
+    case 'c': comp  = optarg; break;
+    case '?': help_options(argv[0]); break;
+
+    default:
+      printf("internal error: what option? %c (%u)\n", c,c);
+    }
+  }
+
+  if (reps < 2)              reps = 2;
+  if (reps > BENCH_MAX_REPS) reps = BENCH_MAX_REPS;
+
+  // whole batches
+  count = (count + BENCH_BATCH_LEN-1) & ~(uint64_t)(BENCH_BATCH_LEN-1);
+
+  sink = get_timestamp();
+
+  printf("reps: %u, hashes/rep: %lu, batch: %u\n\n", reps, count, BENCH_BATCH_LEN);
+  printf("%-20s %-11s %19s  %13s  %17s\n", "function", "mode", "ns/hash (95% CI)", "", "cycles/hash (TSC)");
+
+  if (xsm3) {
+    xorshift_mul_3_t d;
+
+    if (!parse_xorshift_mul_3(xsm3, &d)) {
+      fprintf(stderr, "error: --xsm3 expects s0,m0,s1,m1,s2\n");
+      return -1;
+    }
+
+    set_xorshift_mul_3_gen(&d);
+    bench("xsm3_gen", fxsm3_gen, fxsm3_gen_batch);
+  }
+
+  if (jit) {
+    if (!jit_hash(jit)) return -1;
+    bench(bit_finalizer_name, bit_finalizer, bit_finalizer_batch);
+  }
+
+  if (plug) {
+    if (!plugin_load(plug)) return -1;
+
+    if (plugin->f)
+      bench(bit_finalizer_name, bit_finalizer, bit_finalizer_batch);
+    else
+      fprintf(stderr, "warning: plugin '%s' has no finalizer\n", plugin->name);
+  }
+
+  if (comp) {
+    if (!compose_hash(comp)) return -1;
+    bench("compose", bit_finalizer, bit_finalizer_batch);
+  }
+
+  if ((xsm3 || jit || plug || comp) && !only) return 0;
+
+  for(uint32_t i=0; i<xorshift_mul_3_def_len; i++) {
+    const xorshift_mul_3_t* d = xorshift_mul_3_def+i;
+    if (only && strcmp(only, d->name) != 0) continue;
+    bench(d->name, d->f, d->b);
+  }
+
+  for(uint32_t i=0; i<hash_builtin_def_len; i++) {
+    const hash_builtin_t* d = hash_builtin_def+i;
+    if (only && strcmp(only, d->name) != 0) continue;
+    bench(d->name, d->f, d->b);
+  }
+
+  return 0;
+}
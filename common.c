@@ -13,12 +13,60 @@
 #include <fcntl.h>
 #include <time.h>
 #include <getopt.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
 
 #include "util.h"
 
 #include <float.h>
 
 #include "mini_testu01.h"
+#include "bitops.h"
+
+
+//*****************************************************************************
+// bitops.h runtime dispatch: picked once at startup (before any threads)
+
+#if defined(BITOPS_SCATTER_GATHER_DISPATCH)
+uint64_t (*bit_scatter_64_f)(uint64_t, uint64_t);
+uint64_t (*bit_gather_64_f)(uint64_t, uint64_t);
+#endif
+
+#if defined(BITOPS_REVERSE_ARRAY_DISPATCH)
+void (*bit_reverse_array_64_f)(uint64_t*, const uint64_t*, size_t);
+#endif
+
+__attribute__((constructor)) static void bitops_dispatch(void)
+{
+  __builtin_cpu_init();
+
+#if defined(BITOPS_SCATTER_GATHER_DISPATCH)
+  bool bmi2 = __builtin_cpu_supports("bmi2");
+
+  bit_scatter_64_f = bmi2 ? bit_scatter_64_bmi2 : bit_scatter_64_sw;
+  bit_gather_64_f  = bmi2 ? bit_gather_64_bmi2  : bit_gather_64_sw;
+#endif
+
+#if defined(BITOPS_REVERSE_ARRAY_DISPATCH)
+  if (__builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx512bw"))
+    bit_reverse_array_64_f = bit_reverse_array_64_gfni;
+  else if (__builtin_cpu_supports("avx2"))
+    bit_reverse_array_64_f = bit_reverse_array_64_avx2;
+  else
+    bit_reverse_array_64_f = bit_reverse_array_64_scalar;
+#endif
+}
 
 
 
@@ -79,6 +127,140 @@ static inline uint64_t ur_mum(uint64_t u)
   return u;
 }
 
+//*****************************************************************************
+// wide multiply batches (wyhash, ur_mum). the 128-bit product is a single
+// mulx so the scalar versions step 4 independent lanes. the AVX-512 path
+// builds 8 products from 32-bit partial products (vpmuludq). selected at
+// startup so a build without -march=native still uses it.
+
+#define WIDE_LANES 4
+
+static void wyhash_batch_scalar(uint64_t* d, const uint64_t* s, size_t n)
+{
+  size_t i = 0;
+
+  for(; i+WIDE_LANES <= n; i += WIDE_LANES)
+    for(uint32_t k=0; k<WIDE_LANES; k++) d[i+k] = wyhash(s[i+k]);
+
+  for(; i<n; i++) d[i] = wyhash(s[i]);
+}
+
+static void ur_mum_batch_scalar(uint64_t* d, const uint64_t* s, size_t n)
+{
+  size_t i = 0;
+
+  for(; i+WIDE_LANES <= n; i += WIDE_LANES)
+    for(uint32_t k=0; k<WIDE_LANES; k++) d[i+k] = ur_mum(s[i+k]);
+
+  for(; i<n; i++) d[i] = ur_mum(s[i]);
+}
+
+#if defined(__x86_64__)
+
+#define WIDE_AVX512 __attribute__((target("avx512f,avx512dq")))
+
+// hi^lo of the 128-bit a*b per lane
+WIDE_AVX512 static inline __m512i mul_fold_x8(__m512i a, __m512i b)
+{
+  const __m512i m  = _mm512_set1_epi64(0xffffffff);
+
+  __m512i ah = _mm512_srli_epi64(a, 32);
+  __m512i bh = _mm512_srli_epi64(b, 32);
+  __m512i ll = _mm512_mul_epu32(a,  b);
+  __m512i lh = _mm512_mul_epu32(a,  bh);
+  __m512i hl = _mm512_mul_epu32(ah, b);
+  __m512i hh = _mm512_mul_epu32(ah, bh);
+
+  // carry into the high half from the middle column (fits in 34 bits)
+  __m512i mid = _mm512_add_epi64(_mm512_srli_epi64(ll, 32),
+		_mm512_add_epi64(_mm512_and_si512(lh, m), _mm512_and_si512(hl, m)));
+
+  __m512i lo  = _mm512_or_si512(_mm512_and_si512(ll, m), _mm512_slli_epi64(mid, 32));
+  __m512i hi  = _mm512_add_epi64(_mm512_add_epi64(hh, _mm512_srli_epi64(mid, 32)),
+		_mm512_add_epi64(_mm512_srli_epi64(lh, 32), _mm512_srli_epi64(hl, 32)));
+
+  return _mm512_xor_si512(hi, lo);
+}
+
+// hi^lo of the 128-bit a^2 per lane (one less partial product)
+WIDE_AVX512 static inline __m512i sqr_fold_x8(__m512i a)
+{
+  const __m512i m  = _mm512_set1_epi64(0xffffffff);
+
+  __m512i ah = _mm512_srli_epi64(a, 32);
+  __m512i ll = _mm512_mul_epu32(a,  a);
+  __m512i lh = _mm512_mul_epu32(a,  ah);
+  __m512i hh = _mm512_mul_epu32(ah, ah);
+
+  // 2*lh split so the middle column doesn't overflow
+  __m512i mid = _mm512_add_epi64(_mm512_srli_epi64(ll, 32), _mm512_slli_epi64(_mm512_and_si512(lh, m), 1));
+
+  __m512i lo  = _mm512_or_si512(_mm512_and_si512(ll, m), _mm512_slli_epi64(mid, 32));
+  __m512i hi  = _mm512_add_epi64(_mm512_add_epi64(hh, _mm512_srli_epi64(mid, 32)),
+				 _mm512_slli_epi64(_mm512_srli_epi64(lh, 32), 1));
+
+  return _mm512_xor_si512(hi, lo);
+}
+
+WIDE_AVX512 static void wyhash_batch_avx512(uint64_t* d, const uint64_t* s, size_t n)
+{
+  const __m512i k = _mm512_set1_epi64((int64_t)0xe7037ed1a0b428dbull);
+
+  size_t i = 0;
+
+  for(; i+8 <= n; i += 8)
+    _mm512_storeu_si512(d+i, mul_fold_x8(_mm512_loadu_si512(s+i), k));
+
+  for(; i<n; i++) d[i] = wyhash(s[i]);
+}
+
+WIDE_AVX512 static void ur_mum_batch_avx512(uint64_t* d, const uint64_t* s, size_t n)
+{
+  const __m512i k = _mm512_set1_epi64((int64_t)0x8bb84b93962eacc9);   // ur_mum's
+  const __m512i m = _mm512_set1_epi64(0x7fb5d329728ea185);
+
+  size_t i = 0;
+
+  for(; i+8 <= n; i += 8) {
+    __m512i u = sqr_fold_x8(_mm512_xor_si512(_mm512_loadu_si512(s+i), k));
+    u = _mm512_xor_si512(u, _mm512_srli_epi64(u, 32));
+    _mm512_storeu_si512(d+i, _mm512_mullo_epi64(u, m));
+  }
+
+  for(; i<n; i++) d[i] = ur_mum(s[i]);
+}
+
+static bool wide_avx512(void)
+{
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+}
+
+#else
+
+static bool wide_avx512(void) { return false; }
+
+#define wyhash_batch_avx512 wyhash_batch_scalar
+#define ur_mum_batch_avx512 ur_mum_batch_scalar
+
+#endif
+
+// picked once at startup (before any threads)
+static hash_batch_t* wyhash_batch_f;
+static hash_batch_t* ur_mum_batch_f;
+
+__attribute__((constructor)) static void wide_dispatch(void)
+{
+  __builtin_cpu_init();
+
+  bool v = wide_avx512();
+
+  wyhash_batch_f = v ? wyhash_batch_avx512 : wyhash_batch_scalar;
+  ur_mum_batch_f = v ? ur_mum_batch_avx512 : ur_mum_batch_scalar;
+}
+
+static void wyhash_batch(uint64_t* d, const uint64_t* s, size_t n) { wyhash_batch_f(d,s,n); }
+static void ur_mum_batch(uint64_t* d, const uint64_t* s, size_t n) { ur_mum_batch_f(d,s,n); }
+
 static inline uint64_t no_ur_mum(uint64_t u)
 {
   u  = ur_mum(u);
@@ -88,32 +270,176 @@ static inline uint64_t no_ur_mum(uint64_t u)
 }
 
 
-static inline bool str_eq(char* a, char* b) { return strcmp(a,b) == 0; }
+static inline uint64_t crc32_nl_goof_1(uint64_t x)
+{
+  x  = crc32c_64(x,0) ^ (x ^ (x >> 9));
+  x ^= (x*x) & UINT32_C(~1);
+  x ^= x >> 31;
+  x *= 0xc6a4a7935bd1e995;
+  x  = crc32c_64(x,0) ^ (x ^ (x >> 9));
+  return x;
+}
 
+// batch version. scalar evaluation is front-end bound (~25 uops/value)
+// and crc32 is the only op that can't be vectorized. so per block: the
+// crc32 steps are their own passes with independent lanes per iteration
+// and everything else is straight line loops the compiler vectorizes.
+// crc32 is 1/cycle on a single port so when the running CPU has AVX-512
+// VPCLMULQDQ half of each crc pass is computed by Barrett reduction on
+// another port.
 
-hash_t* get_hash_oneoffs(char* name)
+#define CRC32_BLOCK 256
+
+// c[i] = crc32c_64(s[i],0): 4 independent per iteration
+static void crc32c_64_pass_scalar(uint64_t* c, const uint64_t* s, size_t n)
 {
-  hash_t* h;
-  
-  // dumb thing until there's enough to care. 
-  if (str_eq(name, "wyhash")) {
-    h = wyhash;
-    bit_finalizer      = h;
-    bit_finalizer_name = "hyhash";
-    bit_finalizer_type = hash_type_builtin;
-    return h;
+  size_t i = 0;
+
+  for(; i+4 <= n; i += 4) {
+    uint64_t a = crc32c_64(s[i  ],0);
+    uint64_t b = crc32c_64(s[i+1],0);
+    uint64_t e = crc32c_64(s[i+2],0);
+    uint64_t f = crc32c_64(s[i+3],0);
+    c[i] = a; c[i+1] = b; c[i+2] = e; c[i+3] = f;
   }
 
-  if (str_eq(name, "ur_mum")) {
-    h = ur_mum;
-    bit_finalizer      = h;
-    bit_finalizer_name = "ur_mum";
-    bit_finalizer_type = hash_type_builtin;
-    return h;
+  for(; i<n; i++) c[i] = crc32c_64(s[i],0);
+}
+
+#if defined(__x86_64__)
+
+#define CRC32_VPCLMUL __attribute__((target("avx512f,avx512bw,vpclmulqdq")))
+
+// crc32c_64(x,0) of 8 values: two 32-bit Barrett steps (lo then hi). the
+// reflected constants: mu = x^64/P and P (with the x^32 term). even/odd
+// qwords are kept in separate registers so only the low qword of each
+// 128-bit lane is used and there's one shuffle in and out.
+CRC32_VPCLMUL static inline __m512i crc32c_64_x8(__m512i v)
+{
+  const __m512i mu = _mm512_set1_epi64(0xdea713f1);
+  const __m512i p  = _mm512_set1_epi64(0x105ec76f1);
+  const __m512i m  = _mm512_set1_epi64(0xffffffff);
+
+  __m512i e = v;
+  __m512i o = _mm512_bsrli_epi128(v, 8);
+  __m512i te, to;
+
+  te = _mm512_clmulepi64_epi128(_mm512_and_si512(e,m), mu, 0);
+  to = _mm512_clmulepi64_epi128(_mm512_and_si512(o,m), mu, 0);
+  te = _mm512_clmulepi64_epi128(_mm512_and_si512(te,m), p, 0);
+  to = _mm512_clmulepi64_epi128(_mm512_and_si512(to,m), p, 0);
+  e  = _mm512_srli_epi64(_mm512_xor_si512(e,te), 32);
+  o  = _mm512_srli_epi64(_mm512_xor_si512(o,to), 32);
+
+  te = _mm512_clmulepi64_epi128(e, mu, 0);
+  to = _mm512_clmulepi64_epi128(o, mu, 0);
+  te = _mm512_clmulepi64_epi128(_mm512_and_si512(te,m), p, 0);
+  to = _mm512_clmulepi64_epi128(_mm512_and_si512(to,m), p, 0);
+
+  return _mm512_unpacklo_epi64(_mm512_srli_epi64(te,32), _mm512_srli_epi64(to,32));
+}
+
+// c[i] = crc32c_64(s[i],0): 8 by crc32 and 8 by clmul per iteration
+CRC32_VPCLMUL static void crc32c_64_pass_vpclmul(uint64_t* c, const uint64_t* s, size_t n)
+{
+  size_t i = 0;
+
+  for(; i+16 <= n; i += 16) {
+    for(uint32_t k=0; k<8; k++) c[i+k] = crc32c_64(s[i+k],0);
+    _mm512_storeu_si512(c+i+8, crc32c_64_x8(_mm512_loadu_si512(s+i+8)));
   }
 
+  for(; i<n; i++) c[i] = crc32c_64(s[i],0);
+}
+
+static bool crc32_vpclmul(void)
+{
+  return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("vpclmulqdq");
+}
+
+#else
+
+static bool crc32_vpclmul(void) { return false; }
+
+#define crc32c_64_pass_vpclmul crc32c_64_pass_scalar
+
+#endif
+
+// picked once at startup (before any threads)
+static hash_batch_t* crc32c_64_pass_f;
+
+__attribute__((constructor)) static void crc32_dispatch(void)
+{
+  __builtin_cpu_init();
+  crc32c_64_pass_f = crc32_vpclmul() ? crc32c_64_pass_vpclmul : crc32c_64_pass_scalar;
+}
+
+static void crc32c_64_pass(uint64_t* c, const uint64_t* s, size_t n) { crc32c_64_pass_f(c,s,n); }
+
+hot_kernel static void crc32_nl_goof_1_batch(uint64_t* d, const uint64_t* s, size_t n)
+{
+  uint64_t c[CRC32_BLOCK];
+
+  for(size_t i=0; i<n; i+=CRC32_BLOCK) {
+    size_t e = (n-i < CRC32_BLOCK) ? n-i : CRC32_BLOCK;
+
+    crc32c_64_pass(c, s+i, e);
+
+    for(size_t k=0; k<e; k++) {
+      uint64_t x = s[i+k];
+      x  = c[k] ^ (x ^ (x >> 9));
+      x ^= (x*x) & UINT32_C(~1);
+      x ^= x >> 31;
+      x *= 0xc6a4a7935bd1e995;
+      d[i+k] = x;
+    }
+
+    crc32c_64_pass(c, d+i, e);
+
+    for(size_t k=0; k<e; k++) {
+      uint64_t x = d[i+k];
+      d[i+k] = c[k] ^ (x ^ (x >> 9));
+    }
+  }
+}
+
+// known to be weak: murmurhash64a finalizer
+static inline uint64_t murmur2(uint64_t x)
+{
+  x ^= x >> 47;
+  x *= 0xc6a4a7935bd1e995;
+  x ^= x >> 47;
+  return x;
+}
+
+static inline bool str_eq(char* a, char* b) { return strcmp(a,b) == 0; }
+
+// dumb thing until there's enough to care. 
+const hash_builtin_t hash_builtin_def[] =
+{
+  {.name="wyhash",          .f=wyhash,          .b=wyhash_batch},
+  {.name="ur_mum",          .f=ur_mum,          .b=ur_mum_batch},
+  {.name="murmur2",         .f=murmur2,         .b=hash_batch_generic},
+  {.name="crc32_nl_goof_1", .f=crc32_nl_goof_1, .b=crc32_nl_goof_1_batch},
+};
+
+const uint32_t hash_builtin_def_len = LENGTHOF(hash_builtin_def);
+
+hash_t* get_hash_oneoffs(char* name)
+{
+  for(uint32_t i=0; i<LENGTHOF(hash_builtin_def); i++) {
+    const hash_builtin_t* d = hash_builtin_def+i;
+
+    if (str_eq(name, d->name)) {
+      bit_finalizer       = d->f;
+      bit_finalizer_batch = d->b;
+      bit_finalizer_name  = d->name;
+      bit_finalizer_type  = hash_type_builtin;
+      bit_finalizer_32    = NULL;
+      return d->f;
+    }
+  }
 
-  
   return NULL;
 }
 
@@ -193,30 +519,40 @@ uint64_t fmurmur3(uint64_t x);
 uint64_t fxxhash (uint64_t x);
 uint64_t fdegski (uint64_t x);
 
+#define XSM3_BATCH_DECL(F) void F ## _batch(uint64_t* d, const uint64_t* s, size_t n);
+
+XSM3_BATCH_DECL(fmix01) XSM3_BATCH_DECL(fmix02) XSM3_BATCH_DECL(fmix03) XSM3_BATCH_DECL(fmix04)
+XSM3_BATCH_DECL(fmix05) XSM3_BATCH_DECL(fmix06) XSM3_BATCH_DECL(fmix07) XSM3_BATCH_DECL(fmix08)
+XSM3_BATCH_DECL(fmix09) XSM3_BATCH_DECL(fmix10) XSM3_BATCH_DECL(fmix11) XSM3_BATCH_DECL(fmix12)
+XSM3_BATCH_DECL(fmix13) XSM3_BATCH_DECL(fmix14) XSM3_BATCH_DECL(flea01)
+XSM3_BATCH_DECL(fmurmur3) XSM3_BATCH_DECL(fxxhash) XSM3_BATCH_DECL(fdegski)
+
 const xorshift_mul_3_t xorshift_mul_3_def[] =
 {
   // http://zimbry.blogspot.com/2011/09/better-bit-mixing-improving-on.html
-  {.s0=31, .m0=0x7fb5d329728ea185, .s1=27, .m1=0x81dadef4bc2dd44d, .s2=33, .name="mix01",  .f=fmix01},
-  {.s0=33, .m0=0x64dd81482cbd31d7, .s1=31, .m1=0xe36aa5c613612997, .s2=31, .name="mix02",  .f=fmix02},
-  {.s0=31, .m0=0x99bcf6822b23ca35, .s1=30, .m1=0x14020a57acced8b7, .s2=33, .name="mix03",  .f=fmix03},
-  {.s0=33, .m0=0x62a9d9ed799705f5, .s1=28, .m1=0xcb24d0a5c88c35b3, .s2=32, .name="mix04",  .f=fmix04},
-  {.s0=31, .m0=0x79c135c1674b9add, .s1=29, .m1=0x54c77c86f6913e45, .s2=30, .name="mix05",  .f=fmix05},
-  {.s0=31, .m0=0x69b0bc90bd9a8c49, .s1=27, .m1=0x3d5e661a2a77868d, .s2=30, .name="mix06",  .f=fmix06},
-  {.s0=30, .m0=0x16a6ac37883af045, .s1=26, .m1=0xcc9c31a4274686a5, .s2=32, .name="mix07",  .f=fmix07},
-  {.s0=30, .m0=0x294aa62849912f0b, .s1=28, .m1=0x0a9ba9c8a5b15117, .s2=31, .name="mix08",  .f=fmix08},
-  {.s0=32, .m0=0x4cd6944c5cc20b6d, .s1=29, .m1=0xfc12c5b19d3259e9, .s2=32, .name="mix09",  .f=fmix09},
-  {.s0=30, .m0=0xe4c7e495f4c683f5, .s1=32, .m1=0xfda871baea35a293, .s2=33, .name="mix10",  .f=fmix10},
-  {.s0=27, .m0=0x97d461a8b11570d9, .s1=28, .m1=0x02271eb7c6c4cd6b, .s2=32, .name="mix11",  .f=fmix11},
-  {.s0=29, .m0=0x3cd0eb9d47532dfb, .s1=26, .m1=0x63660277528772bb, .s2=33, .name="mix12",  .f=fmix12},
-  {.s0=30, .m0=0xbf58476d1ce4e5b9, .s1=27, .m1=0x94d049bb133111eb, .s2=31, .name="mix13",  .f=fmix13},
-  {.s0=30, .m0=0x4be98134a5976fd3, .s1=29, .m1=0x3bc0993a5ad19a13, .s2=31, .name="mix14",  .f=fmix14},
-
-  {.s0=32, .m0=0xdaba0b6eb09322e3, .s1=32, .m1=0xdaba0b6eb09322e3, .s2=32, .name="lea01",  .f=flea01},
-  {.s0=33, .m0=0xff51afd7ed558ccd, .s1=33, .m1=0xc4ceb9fe1a85ec53, .s2=33, .name="murmur3",.f=fmurmur3},
-  {.s0=33, .m0=0xc2b2ae3d27d4eb4f, .s1=29, .m1=0x165667b19e3779f9, .s2=32, .name="xxhash", .f=fxxhash},
-  {.s0=32, .m0=0xdaba0b6eb09322e3, .s1=32, .m1=0xdaba0b6eb09322e3, .s2=32, .name="degski", .f=fdegski},
+  {.s0=31, .m0=0x7fb5d329728ea185, .s1=27, .m1=0x81dadef4bc2dd44d, .s2=33, .name="mix01",  .f=fmix01, .b=fmix01_batch},
+  {.s0=33, .m0=0x64dd81482cbd31d7, .s1=31, .m1=0xe36aa5c613612997, .s2=31, .name="mix02",  .f=fmix02, .b=fmix02_batch},
+  {.s0=31, .m0=0x99bcf6822b23ca35, .s1=30, .m1=0x14020a57acced8b7, .s2=33, .name="mix03",  .f=fmix03, .b=fmix03_batch},
+  {.s0=33, .m0=0x62a9d9ed799705f5, .s1=28, .m1=0xcb24d0a5c88c35b3, .s2=32, .name="mix04",  .f=fmix04, .b=fmix04_batch},
+  {.s0=31, .m0=0x79c135c1674b9add, .s1=29, .m1=0x54c77c86f6913e45, .s2=30, .name="mix05",  .f=fmix05, .b=fmix05_batch},
+  {.s0=31, .m0=0x69b0bc90bd9a8c49, .s1=27, .m1=0x3d5e661a2a77868d, .s2=30, .name="mix06",  .f=fmix06, .b=fmix06_batch},
+  {.s0=30, .m0=0x16a6ac37883af045, .s1=26, .m1=0xcc9c31a4274686a5, .s2=32, .name="mix07",  .f=fmix07, .b=fmix07_batch},
+  {.s0=30, .m0=0x294aa62849912f0b, .s1=28, .m1=0x0a9ba9c8a5b15117, .s2=31, .name="mix08",  .f=fmix08, .b=fmix08_batch},
+  {.s0=32, .m0=0x4cd6944c5cc20b6d, .s1=29, .m1=0xfc12c5b19d3259e9, .s2=32, .name="mix09",  .f=fmix09, .b=fmix09_batch},
+  {.s0=30, .m0=0xe4c7e495f4c683f5, .s1=32, .m1=0xfda871baea35a293, .s2=33, .name="mix10",  .f=fmix10, .b=fmix10_batch},
+  {.s0=27, .m0=0x97d461a8b11570d9, .s1=28, .m1=0x02271eb7c6c4cd6b, .s2=32, .name="mix11",  .f=fmix11, .b=fmix11_batch},
+  {.s0=29, .m0=0x3cd0eb9d47532dfb, .s1=26, .m1=0x63660277528772bb, .s2=33, .name="mix12",  .f=fmix12, .b=fmix12_batch},
+  {.s0=30, .m0=0xbf58476d1ce4e5b9, .s1=27, .m1=0x94d049bb133111eb, .s2=31, .name="mix13",  .f=fmix13, .b=fmix13_batch},
+  {.s0=30, .m0=0x4be98134a5976fd3, .s1=29, .m1=0x3bc0993a5ad19a13, .s2=31, .name="mix14",  .f=fmix14, .b=fmix14_batch},
+
+  {.s0=32, .m0=0xdaba0b6eb09322e3, .s1=32, .m1=0xdaba0b6eb09322e3, .s2=32, .name="lea01",  .f=flea01, .b=flea01_batch},
+  {.s0=33, .m0=0xff51afd7ed558ccd, .s1=33, .m1=0xc4ceb9fe1a85ec53, .s2=33, .name="murmur3",.f=fmurmur3, .b=fmurmur3_batch},
+  {.s0=33, .m0=0xc2b2ae3d27d4eb4f, .s1=29, .m1=0x165667b19e3779f9, .s2=32, .name="xxhash", .f=fxxhash, .b=fxxhash_batch},
+  {.s0=32, .m0=0xdaba0b6eb09322e3, .s1=32, .m1=0xdaba0b6eb09322e3, .s2=32, .name="degski", .f=fdegski, .b=fdegski_batch},
 };
 
+const uint32_t xorshift_mul_3_def_len = LENGTHOF(xorshift_mul_3_def);
+
 // code expand
 uint64_t fmix01(uint64_t x) { return build_xorshift_mul_3(x, xorshift_mul_3_def+mix01); }
 uint64_t fmix02(uint64_t x) { return build_xorshift_mul_3(x, xorshift_mul_3_def+mix02); }
@@ -238,20 +574,42 @@ uint64_t fmurmur3(uint64_t x) { return build_xorshift_mul_3(x, xorshift_mul_3_de
 uint64_t fxxhash (uint64_t x) { return build_xorshift_mul_3(x, xorshift_mul_3_def+xxhash); }
 uint64_t fdegski (uint64_t x) { return build_xorshift_mul_3(x, xorshift_mul_3_def+degski); }
 
+// batch expand: constants are folded the same as the scalar versions
+#define XSM3_BATCH(F) \
+  hot_kernel void F ## _batch(uint64_t* d, const uint64_t* s, size_t n) { for(size_t i=0; i<n; i++) d[i] = F(s[i]); }
+
+XSM3_BATCH(fmix01) XSM3_BATCH(fmix02) XSM3_BATCH(fmix03) XSM3_BATCH(fmix04)
+XSM3_BATCH(fmix05) XSM3_BATCH(fmix06) XSM3_BATCH(fmix07) XSM3_BATCH(fmix08)
+XSM3_BATCH(fmix09) XSM3_BATCH(fmix10) XSM3_BATCH(fmix11) XSM3_BATCH(fmix12)
+XSM3_BATCH(fmix13) XSM3_BATCH(fmix14) XSM3_BATCH(flea01)
+XSM3_BATCH(fmurmur3) XSM3_BATCH(fxxhash) XSM3_BATCH(fdegski)
+
+// fallback for anything without a specialized batch version
+void hash_batch_generic(uint64_t* d, const uint64_t* s, size_t n)
+{
+  hash_t* f = bit_finalizer;
+
+  for(size_t i=0; i<n; i++) d[i] = f(s[i]);
+}
+
 
 //*****************************************************************************
 
 // active function 
-hash_t*   bit_finalizer      = hash;  // temp hack
-char*     bit_finalizer_name = TOSTRING(hash);
-uint32_t  bit_finalizer_type = hash_type_default;
-uint32_t  bit_finalizer_id   = (uint32_t)-1;
+hash_t*       bit_finalizer       = hash;  // temp hack
+hash_batch_t* bit_finalizer_batch = hash_batch_generic;
+hash32_t*     bit_finalizer_32    = NULL;
+hash32_batch_t* bit_finalizer_32_batch = NULL;
+char*         bit_finalizer_name  = TOSTRING(hash);
+uint32_t      bit_finalizer_type  = hash_type_default;
+uint32_t      bit_finalizer_id    = (uint32_t)-1;
 
 
 // dump c code to stdout
-void pretty_print_xorshift_mul_3(const xorshift_mul_3_t* def, uint32_t indent)
+void fpretty_print_xorshift_mul_3(FILE* file, const xorshift_mul_3_t* def, uint32_t indent)
 {
-  printf("%*suint64_t %s(uint64_t x)\n"
+  fprintf(file,
+	 "%*suint64_t %s(uint64_t x)\n"
 	 "%*s{\n"
 	 "%*s  x = (x ^ (x >> %2u)) * 0x%016lx;\n"
 	 "%*s  x = (x ^ (x >> %2u)) * 0x%016lx;\n"
@@ -267,6 +625,11 @@ void pretty_print_xorshift_mul_3(const xorshift_mul_3_t* def, uint32_t indent)
 	 indent,"");
 }
 
+void pretty_print_xorshift_mul_3(const xorshift_mul_3_t* def, uint32_t indent)
+{
+  fpretty_print_xorshift_mul_3(stdout, def, indent);
+}
+
 // list hardcoded parameter versions
 void print_xorshift_mul_3(void)
 {
@@ -279,6 +642,69 @@ void print_xorshift_mul_3(void)
 
 const xorshift_mul_3_t* xorshift_mul_3_current = NULL;
 
+// parse "s0,m0,s1,m1,s2" (order of application) into 'def'. Shifts
+// must be on [1,63]. returns false if malformed. Even multipliers are
+// accepted (not a bijection) so the caller can decide.
+bool parse_xorshift_mul_3(char* str, xorshift_mul_3_t* def)
+{
+  uint64_t v[5];
+  char*    end = str;
+
+  for(uint32_t i=0; i<5; i++) {
+    v[i] = strtoul(str, &end, 0);
+
+    if (end == str) return false;
+    if (*end != ((i<4) ? ',' : 0)) return false;
+
+    str = end+1;
+  }
+
+  for(uint32_t i=0; i<5; i+=2)
+    if (v[i]-1 > 62) return false;
+
+  def->s0   = (uint8_t)v[0];
+  def->m0   = v[1];
+  def->s1   = (uint8_t)v[2];
+  def->m1   = v[3];
+  def->s2   = (uint8_t)v[4];
+  def->name = "xsm3_gen";
+  def->f    = NULL;
+  def->b    = NULL;
+
+  return true;
+}
+
+// runtime parameters (the 'xorshift_mul_3_gen' slot)
+uint64_t fxsm3_gen(uint64_t x) { return build_xorshift_mul_3(x, &xorshift_mul_3_gen); }
+
+// batch of the runtime slot. the parameters are passed by value: the
+// stores to 'd' could otherwise alias the global so they'd be reloaded
+// per element. this way they stay in registers like the compiled-in.
+hot_kernel static void fxsm3_batch(uint64_t* d, const uint64_t* s, size_t n, const xorshift_mul_3_t p)
+{
+  for(size_t i=0; i<n; i++) d[i] = build_xorshift_mul_3(s[i], &p);
+}
+
+void fxsm3_gen_batch(uint64_t* d, const uint64_t* s, size_t n)
+{
+  fxsm3_batch(d, s, n, xorshift_mul_3_gen);
+}
+
+// make 'def' the active finalizer via the runtime slot
+void set_xorshift_mul_3_gen(const xorshift_mul_3_t* def)
+{
+  xorshift_mul_3_gen     = *def;
+  xorshift_mul_3_gen.f   = fxsm3_gen;
+  xorshift_mul_3_gen.b   = fxsm3_gen_batch;
+  xorshift_mul_3_current = &xorshift_mul_3_gen;
+
+  bit_finalizer       = fxsm3_gen;
+  bit_finalizer_batch = fxsm3_gen_batch;
+  bit_finalizer_name  = def->name;
+  bit_finalizer_type  = hash_type_xsm3;
+  bit_finalizer_32    = NULL;
+}
+
 hash_t* get_xorshift_mul_3(char* name)
 {
   for(uint32_t i=0; i<LENGTHOF(xorshift_mul_3_def); i++) {
@@ -298,9 +724,11 @@ hash_t* get_hash(char* name)
   hash_t* h = get_xorshift_mul_3(name);
 
   if (h) {
-    bit_finalizer      = h;
-    bit_finalizer_name = name;
-    bit_finalizer_type = hash_type_xsm3;
+    bit_finalizer       = h;
+    bit_finalizer_batch = xorshift_mul_3_current->b;
+    bit_finalizer_name  = name;
+    bit_finalizer_type  = hash_type_xsm3;
+    bit_finalizer_32    = NULL;
     return h;
   }
 
@@ -313,16 +741,990 @@ hash_t* get_hash(char* name)
   return bit_finalizer;
 }
 
+//*****************************************************************************
+// compiled finalizers (--jit=SPEC). The source is emitted to the cache
+// directory, built into a shared object by the system compiler ($CC or
+// 'cc') and dlopen'd. Objects are named by a hash of the source and build
+// command so repeated runs skip the compile. SPEC is either xorshift_mul_3
+// parameters "s0,m0,s1,m1,s2", a C expression in 'x' or a function body
+// (statements with a return).
+
+static const char jit_build[] = "%s -O3 -march=native -fPIC -shared -w -o %s %s";
+
+static const char jit_prologue[] =
+  "#include <stdint.h>\n"
+  "#include <stddef.h>\n\n";
+
+static const char jit_epilogue[] =
+  "\n"
+  "uint64_t jit_hash(uint64_t x) { return jit_f(x); }\n\n"
+  "void jit_hash_batch(uint64_t* d, const uint64_t* s, size_t n)\n"
+  "{\n"
+  "  for(size_t i=0; i<n; i++) d[i] = jit_f(s[i]);\n"
+  "}\n";
+
+char jit_name[32];
+
+static uint64_t jit_fnv(const char* str, uint64_t h)
+{
+  return fnv_64(str, strlen(str), h);
+}
 
-void bit_finalizer_pretty_print(void)
+// the finalizer source into 'buf'. false if it doesn't fit
+static bool jit_source(char* buf, size_t len, char* spec)
+{
+  xorshift_mul_3_t def;
+  FILE*            file = fmemopen(buf, len, "w");
+
+  if (!file) return false;
+
+  fputs(jit_prologue, file);
+
+  if (parse_xorshift_mul_3(spec, &def)) {
+    def.name = "jit_f";
+    fputs("static inline ", file);
+    fpretty_print_xorshift_mul_3(file, &def, 0);
+  }
+  else if (strchr(spec, ';'))
+    fprintf(file, "static inline uint64_t jit_f(uint64_t x)\n{\n  %s\n}\n", spec);
+  else
+    fprintf(file, "static inline uint64_t jit_f(uint64_t x)\n{\n  return %s;\n}\n", spec);
+
+  fputs(jit_epilogue, file);
+
+  bool ok = (ftell(file) < (long)len-1);
+
+  fclose(file);
+
+  return ok;
+}
+
+// 's' as a single quoted shell word into 'buf'. false if it doesn't fit
+static bool jit_quote(char* buf, size_t len, const char* s)
+{
+  size_t n = 0;
+
+  if (len < 3) return false;
+
+  buf[n++] = '\'';
+
+  for(; *s; s++) {
+    // ' -> '\'' (close, escaped quote, reopen)
+    const char* r = (*s == '\'') ? "'\\''" : NULL;
+    size_t      k = r ? 4 : 1;
+
+    if (n+k+2 > len) return false;
+
+    if (r) { memcpy(buf+n, r, k); n += k; }
+    else   buf[n++] = *s;
+  }
+
+  buf[n++] = '\'';
+  buf[n]   = 0;
+
+  return true;
+}
+
+static bool jit_dir(char* dir, size_t len)
+{
+  char* base = getenv("XDG_CACHE_HOME");
+
+  if (base)
+    snprintf(dir, len, "%s", base);
+  else
+    snprintf(dir, len, "%s/.cache", (base = getenv("HOME")) ? base : ".");
+
+  mkdir(dir, 0755);
+  strncat(dir, "/mini_testu01", len-strlen(dir)-1);
+  mkdir(dir, 0755);
+  strncat(dir, "/jit", len-strlen(dir)-1);
+
+  return (mkdir(dir, 0755) == 0 || errno == EEXIST);
+}
+
+hash_t* jit_hash(char* spec)
 {
+  static char src[16384];
+  char        dir[4096];
+  char        so[4200], tmp[4300], cfile[4200], cmd[12800];
+  char*       cc = getenv("CC");
+
+  if (!cc || !cc[0]) cc = "cc";
+
+  if (!jit_source(src, sizeof(src), spec)) {
+    fprintf(stderr, "error: --jit source too long\n");
+    return NULL;
+  }
+
+  if (!jit_dir(dir, sizeof(dir))) {
+    fprintf(stderr, "error: couldn't create '%s'\n", dir);
+    return NULL;
+  }
+
+  uint64_t key = jit_fnv(cc, jit_fnv(jit_build, jit_fnv(src, FNV_64_INIT)));
+
+  snprintf(so, sizeof(so), "%s/%016lx.so", dir, key);
+
+  // source and object to private names then rename the object: concurrent
+  // runs can race
+  if (access(so, R_OK) != 0) {
+    FILE* file;
+    int   pid = (int)getpid();
+
+    snprintf(cfile, sizeof(cfile), "%s/%016lx.%d.c", dir, key, pid);
+    snprintf(tmp,   sizeof(tmp),   "%s.%d", so, pid);
+
+    if (!(file = fopen(cfile, "w")) || fputs(src, file) < 0 || fclose(file) != 0) {
+      fprintf(stderr, "error: couldn't write '%s'\n", cfile);
+      unlink(cfile);
+      return NULL;
+    }
+
+    // $CC is a command line (like make's) but the paths are quoted
+    char qtmp[sizeof(tmp)*4+3], qcfile[sizeof(cfile)*4+3];
+
+    if (!jit_quote(qtmp, sizeof(qtmp), tmp) || !jit_quote(qcfile, sizeof(qcfile), cfile)) {
+      fprintf(stderr, "error: --jit path too long\n");
+      unlink(cfile);
+      return NULL;
+    }
+
+    if (snprintf(cmd, sizeof(cmd), jit_build, cc, qtmp, qcfile) >= (int)sizeof(cmd)) {
+      fprintf(stderr, "error: --jit build command too long\n");
+      unlink(cfile);
+      return NULL;
+    }
+
+    bool ok = (system(cmd) == 0 && rename(tmp, so) == 0);
+
+    unlink(cfile);
+
+    if (!ok) {
+      fprintf(stderr, "error: --jit build failed: %s\n", cmd);
+      unlink(tmp);
+      return NULL;
+    }
+  }
+
+  void* lib = dlopen(so, RTLD_NOW|RTLD_LOCAL);
+
+  if (!lib) {
+    fprintf(stderr, "error: %s\n", dlerror());
+    return NULL;
+  }
+
+  hash_t*       f;
+  hash_batch_t* b;
+
+  // POSIX idiom: ISO C has no object to function pointer conversion
+  *(void**)(&f) = dlsym(lib, "jit_hash");
+  *(void**)(&b) = dlsym(lib, "jit_hash_batch");
+
+  if (!f || !b) {
+    fprintf(stderr, "error: '%s' missing entry points\n", so);
+    return NULL;
+  }
+
+  snprintf(jit_name, sizeof(jit_name), "jit:%016lx", key);
+
+  bit_finalizer       = f;
+  bit_finalizer_batch = b;
+  bit_finalizer_name  = jit_name;
+  bit_finalizer_type  = hash_type_jit;
+  bit_finalizer_32    = NULL;
+
+  return f;
 }
 
 //*****************************************************************************
+// finalizer composition (--compose=SPEC). SPEC is a comma separated list
+// of stages applied in order:
+//   xsr:N   x ^= x >> N          xsl:N  x ^= x << N
+//   mul:K   x *= K               add:K  x += K
+//   xor:K   x ^= K               rot:N  rotate right by N
+//   crc:K   x ^= crc32c_64(x,K)  (K optional, default 0)
+//   mx:K    hi ^ lo of x*K       (wyhash_mx)
+//   sqr:K   hi ^ lo of (x^K)^2   (ur_mum)
+// parsed once into an op array. the batch interpreter runs each op over
+// the whole block so the dispatch is per block and the inner loops are
+// the same straight line code as a compiled-in version.
 
-uint64_t get_timestamp(void)
+enum {
+  compose_xsr, compose_xsl, compose_mul, compose_add, compose_xor,
+  compose_rot, compose_crc, compose_mx,  compose_sqr
+};
+
+static const struct {
+  char* name;
+  bool  shift;          // argument is a shift/rotate amount
+  bool  optional;       // argument can be omitted (zero)
+  bool  round;          // ends a round (nonlinear step) for --stages
+} compose_stage[] = {
+  [compose_xsr] = {"xsr", true,  false, false},
+  [compose_xsl] = {"xsl", true,  false, false},
+  [compose_mul] = {"mul", false, false, true },
+  [compose_add] = {"add", false, false, false},
+  [compose_xor] = {"xor", false, false, false},
+  [compose_rot] = {"rot", true,  false, false},
+  [compose_crc] = {"crc", false, true,  true },
+  [compose_mx]  = {"mx",  false, false, true },
+  [compose_sqr] = {"sqr", false, false, true },
+};
+
+
+typedef struct {
+  uint32_t type;
+  uint32_t s;
+  uint64_t k;
+} compose_op_t;
+
+compose_op_t compose_ops[COMPOSE_MAX_OPS];
+uint32_t     compose_len = 0;
+
+static inline uint64_t compose_sqr_fold(uint64_t x, uint64_t k)
 {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  __uint128_t t = (__uint128_t)(x^k);
+  t *= t;
+  return (uint64_t)(t ^ (t >> 64));
+}
+
+static inline uint64_t compose_apply(uint64_t x, const compose_op_t* op)
+{
+  switch(op->type) {
+    case compose_xsr: return x ^ (x >> op->s);
+    case compose_xsl: return x ^ (x << op->s);
+    case compose_mul: return x * op->k;
+    case compose_add: return x + op->k;
+    case compose_xor: return x ^ op->k;
+    case compose_rot: return (x >> op->s) | (x << (64-op->s));
+    case compose_crc: return x ^ crc32c_64(x, (uint32_t)op->k);
+    case compose_mx:  return wyhash_mx(x, op->k);
+    default:          return compose_sqr_fold(x, op->k);
+  }
+}
+
+uint64_t compose_f(uint64_t x)
+{
+  for(uint32_t i=0; i<compose_len; i++)
+    x = compose_apply(x, compose_ops+i);
+
+  return x;
+}
+
+// the first op reads 's' and the remainder are in-place on 'd'
+#define COMPOSE_LOOP(EXPR) \
+  for(size_t i=0; i<n; i++) { uint64_t x = src[i]; d[i] = EXPR; } break;
+
+// ops [first,end) of the composition
+hot_kernel void compose_run(uint64_t* d, const uint64_t* s, size_t n, uint32_t first, uint32_t end)
+{
+  const uint64_t* src = s;
+
+  for(uint32_t j=first; j<end; j++, src=d) {
+    const uint64_t k  = compose_ops[j].k;
+    const uint32_t sh = compose_ops[j].s;
+
+    switch(compose_ops[j].type) {
+      case compose_xsr: COMPOSE_LOOP(x ^ (x >> sh));
+      case compose_xsl: COMPOSE_LOOP(x ^ (x << sh));
+      case compose_mul: COMPOSE_LOOP(x * k);
+      case compose_add: COMPOSE_LOOP(x + k);
+      case compose_xor: COMPOSE_LOOP(x ^ k);
+      case compose_rot: COMPOSE_LOOP((x >> sh) | (x << (64-sh)));
+      case compose_crc: COMPOSE_LOOP(x ^ crc32c_64(x, (uint32_t)k));
+      case compose_mx:  COMPOSE_LOOP(wyhash_mx(x, k));
+      default:          COMPOSE_LOOP(compose_sqr_fold(x, k));
+    }
+  }
+}
+
+#undef COMPOSE_LOOP
+
+void compose_batch(uint64_t* d, const uint64_t* s, size_t n)
+{
+  compose_run(d, s, n, 0, compose_len);
+}
+
+// op index one past the end of each round (the last is always the end
+// of the composition). returns the number of rounds
+uint32_t compose_rounds(uint32_t* end)
+{
+  uint32_t n = 0;
+
+  for(uint32_t i=0; i<compose_len; i++)
+    if (compose_stage[compose_ops[i].type].round || i == compose_len-1) end[n++] = i+1;
+
+  return n;
+}
+
+// canonical spec of ops [first,end)
+void compose_spec(char* buf, size_t len, uint32_t first, uint32_t end)
+{
+  size_t p = 0;
+
+  buf[0] = 0;
+
+  for(uint32_t i=first; i<end && p<len; i++) {
+    const compose_op_t* op = compose_ops+i;
+    const char*         c  = (i != first) ? "," : "";
+
+    if (compose_stage[op->type].optional && op->k == 0)
+      p += (size_t)snprintf(buf+p, len-p, "%s%s", c, compose_stage[op->type].name);
+    else if (compose_stage[op->type].shift)
+      p += (size_t)snprintf(buf+p, len-p, "%s%s:%u", c, compose_stage[op->type].name, op->s);
+    else
+      p += (size_t)snprintf(buf+p, len-p, "%s%s:0x%016lx", c, compose_stage[op->type].name, op->k);
+  }
+}
+
+static bool compose_parse(char* spec)
+{
+  char* str = strdup(spec);
+  char* save;
+
+  compose_len = 0;
+
+  for(char* t = strtok_r(str, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+    char*    arg = strchr(t, ':');
+    uint32_t i;
+
+    if (arg) *arg++ = 0;
+
+    for(i=0; i<LENGTHOF(compose_stage); i++)
+      if (strcmp(t, compose_stage[i].name) == 0) break;
+
+    if (i == LENGTHOF(compose_stage)) {
+      fprintf(stderr, "error: --compose: unknown stage '%s'\n", t);
+      free(str);
+      return false;
+    }
+
+    if (compose_len == COMPOSE_MAX_OPS) {
+      fprintf(stderr, "error: --compose: more than %u stages\n", COMPOSE_MAX_OPS);
+      free(str);
+      return false;
+    }
+
+    char*    end = arg;
+    uint64_t v   = arg ? strtoull(arg, &end, 0) : 0;
+
+    if ((!arg && !compose_stage[i].optional) || (arg && (end == arg || *end)) ||
+	(compose_stage[i].shift && (v == 0 || v > 63))) {
+      fprintf(stderr, "error: --compose: bad or missing argument for '%s'%s\n", t,
+	      compose_stage[i].shift ? " (on [1,63])" : "");
+      free(str);
+      return false;
+    }
+
+    compose_ops[compose_len++] = (compose_op_t){.type=i, .s=(uint32_t)v, .k=v};
+  }
+
+  free(str);
+
+  if (compose_len == 0) fprintf(stderr, "error: --compose: no stages\n");
+
+  return compose_len != 0;
+}
+
+hash_t* compose_hash(char* spec)
+{
+  static char* name = NULL;
+
+  if (!compose_parse(spec)) return NULL;
+
+  // the full spec: it's the --cache/--log key
+  char* full = malloc(strlen(spec)+9);
+
+  if (!full) {
+    fprintf(stderr, "error: --compose: allocation failed\n");
+    return NULL;
+  }
+
+  sprintf(full, "compose:%s", spec);
+  free(name);
+  name = full;
+
+  bit_finalizer       = compose_f;
+  bit_finalizer_batch = compose_batch;
+  bit_finalizer_name  = name;
+  bit_finalizer_type  = hash_type_compose;
+  bit_finalizer_32    = NULL;
+
+  return compose_f;
+}
+
+//*****************************************************************************
+// avalanche accumulator (see mini_testu01.h). a lookup spreads each byte
+// of a difference into a 64-bit word with one bit per byte so 8 output
+// bits are counted per add. the byte lanes of an input bit are flushed
+// to the totals after SAC_FLUSH differences (before they can overflow).
+
+#define SAC_FLUSH 255
+
+static uint64_t sac_lut[256];
+
+__attribute__((constructor)) static void sac_lut_init(void)
+{
+  for(uint32_t b=0; b<256; b++) {
+    uint64_t v = 0;
+    for(uint32_t k=0; k<8; k++)
+      v |= (uint64_t)((b >> k) & 1) << (8*k);
+    sac_lut[b] = v;
+  }
+}
+
+static void sac_acc_flush_bit(sac_acc_t* a, uint32_t b)
+{
+  for(uint32_t j=0; j<64; j++)
+    a->total[b][j] += (a->lane[b][j >> 3] >> (8*(j & 7))) & 0xff;
+
+  memset(a->lane[b], 0, sizeof(a->lane[b]));
+  a->pending[b] = 0;
+}
+
+void sac_acc_clear(sac_acc_t* a)
+{
+  memset(a, 0, sizeof(*a));
+}
+
+void sac_acc_add(sac_acc_t* a, uint32_t b, const uint64_t* d, size_t n)
+{
+  uint64_t* lane = a->lane[b];
+
+  while (n != 0) {
+    size_t e = SAC_FLUSH - a->pending[b];
+
+    if (e > n) e = n;
+
+    for(size_t i=0; i<e; i++) {
+      uint64_t v = d[i];
+      for(uint32_t l=0; l<8; l++)
+	lane[l] += sac_lut[(v >> (8*l)) & 0xff];
+    }
+
+    d += e;
+    n -= e;
+
+    if ((a->pending[b] += (uint32_t)e) == SAC_FLUSH) sac_acc_flush_bit(a, b);
+  }
+}
+
+void sac_acc_row(sac_acc_t* a, const uint64_t* d, uint32_t bits)
+{
+  uint32_t bytes = (bits+7) >> 3;
+
+  for(uint32_t b=0; b<bits; b++) {
+    uint64_t v = d[b];
+
+    for(uint32_t l=0; l<bytes; l++)
+      a->lane[b][l] += sac_lut[(v >> (8*l)) & 0xff];
+
+    if (++a->pending[b] == SAC_FLUSH) sac_acc_flush_bit(a, b);
+  }
+}
+
+void sac_acc_flush(sac_acc_t* a)
+{
+  for(uint32_t b=0; b<64; b++)
+    if (a->pending[b] != 0) sac_acc_flush_bit(a, b);
+}
+
+void sac_acc_merge(sac_acc_t* d, sac_acc_t* s)
+{
+  sac_acc_flush(s);
+
+  for(uint32_t b=0; b<64; b++)
+    for(uint32_t j=0; j<64; j++)
+      d->total[b][j] += s->total[b][j];
+}
+
+double sac_acc_fitness(sac_acc_t* a, uint32_t bits, uint64_t n, double* peak)
+{
+  double scale = 1.0/(double)n;
+  double sum2  = 0.0;
+  double max   = 0.0;
+
+  sac_acc_flush(a);
+
+  for(uint32_t b=0; b<bits; b++) {
+    for(uint32_t j=0; j<bits; j++) {
+      double v = (double)a->total[b][j]*scale - 0.5;
+      sum2 += v*v;
+      max   = fmax(max, fabs(v));
+    }
+  }
+
+  if (peak) *peak = max;
+
+  return 4.0*(double)n*sum2/(double)(bits*bits);
+}
+
+//*****************************************************************************
+// differential inputs (--delta=LIST): each item is an input relation
+//   VALUE      x + VALUE
+//   ^VALUE     x ^ VALUE
+//   inc, K*inc x + K*inc   (the Weyl increment, '^' prefix is allowed)
+
+uint32_t parse_delta_list(char* list, uint64_t inc, delta_t* d, uint32_t max)
+{
+  char*    str = strdup(list);
+  char*    save;
+  uint32_t n   = 0;
+
+  for(char* t = strtok_r(str, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+    char*    p = t + (t[0] == '^');
+    char*    end;
+    uint64_t v;
+
+    if (n == max) {
+      fprintf(stderr, "error: --delta: more than %u deltas\n", max);
+      free(str);
+      return 0;
+    }
+
+    if (strcmp(p, "inc") == 0)
+      v = inc;
+    else {
+      v = strtoull(p, &end, 0);
+
+      if (end != p && end[0] == '*' && strcmp(end+1, "inc") == 0)
+	v *= inc;
+      else if (end == p || *end) {
+	fprintf(stderr, "error: --delta: malformed '%s'\n", t);
+	free(str);
+	return 0;
+      }
+    }
+
+    d[n].add  = (t[0] == '^') ? 0 : v;
+    d[n].mask = (t[0] == '^') ? v : 0;
+    d[n].name = strdup(t);
+    n++;
+  }
+
+  free(str);
+
+  if (n == 0) fprintf(stderr, "error: --delta: no deltas\n");
+
+  return n;
+}
+
+//*****************************************************************************
+// plugins (--plugin=PATH, see plugin.h). The selected name is the declared
+// name plus a hash of the object's contents: rebuilds under the same name
+// don't share --cache/--log entries.
+
+const mtu_plugin_t* plugin = NULL;
+
+// FNV-1a of the contents of 'path'. false if unreadable
+static bool plugin_id(char* path, uint64_t* id)
+{
+  FILE*    file = fopen(path, "rb");
+  uint8_t  buf[16384];
+  uint64_t h = FNV_64_INIT;
+  size_t   n;
+
+  if (!file) return false;
+
+  while ((n = fread(buf, 1, sizeof(buf), file)) != 0)
+    h = fnv_64(buf, n, h);
+
+  bool ok = !ferror(file);
+
+  fclose(file);
+  *id = h;
+
+  return ok;
+}
+
+const mtu_plugin_t* plugin_load(char* path)
+{
+  char buf[4096];
+
+  // otherwise dlopen searches the library paths
+  if (!strchr(path, '/')) {
+    snprintf(buf, sizeof(buf), "./%s", path);
+    path = buf;
+  }
+
+  void* lib = dlopen(path, RTLD_NOW|RTLD_LOCAL);
+
+  if (!lib) {
+    fprintf(stderr, "error: %s\n", dlerror());
+    return NULL;
+  }
+
+  const mtu_plugin_t* p = dlsym(lib, "mtu_plugin");
+
+  if (!p) {
+    fprintf(stderr, "error: '%s' doesn't export 'mtu_plugin'\n", path);
+    return NULL;
+  }
+
+  if (p->abi != MTU_PLUGIN_ABI) {
+    fprintf(stderr, "error: '%s' is plugin ABI %u (expected %u)\n", path, p->abi, MTU_PLUGIN_ABI);
+    return NULL;
+  }
+
+  if (!p->name || !(p->f || (p->next && p->seed))) {
+    fprintf(stderr, "error: '%s' needs a name and f or seed/next\n", path);
+    return NULL;
+  }
+
+  if (p->f) {
+    bit_finalizer       = p->f;
+    bit_finalizer_batch = p->b ? p->b : hash_batch_generic;
+  }
+
+  uint64_t id;
+
+  if (!plugin_id(path, &id)) {
+    fprintf(stderr, "error: couldn't read '%s'\n", path);
+    return NULL;
+  }
+
+  char* name = malloc(strlen(p->name)+18);
+
+  if (!name) {
+    fprintf(stderr, "error: plugin name allocation failed\n");
+    return NULL;
+  }
+
+  sprintf(name, "%s:%016lx", p->name, id);
+
+  bit_finalizer_name = name;
+  bit_finalizer_type = hash_type_plugin;
+  bit_finalizer_32   = NULL;
+  plugin             = p;
+
+  return p;
+}
+
+//*****************************************************************************
+// 32-bit xorshift/multiply finalizers. The entire input space is small
+// enough to enumerate so these can be tested exhaustively.
+
+xorshift_mul_3_32_t xorshift_mul_3_32_gen;
+
+static inline_always uint32_t build_xorshift_mul_3_32(uint32_t x, const xorshift_mul_3_32_t* const def)
+{
+  uint32_t m0 = def->m0;
+  uint32_t m1 = def->m1;
+  uint32_t s0 = def->s0;
+  uint32_t s1 = def->s1;
+  uint32_t s2 = def->s2;
+
+  x = (x ^ (x >> s0)) * m0;
+  x = (x ^ (x >> s1)) * m1;
+  x = (x ^ (x >> s2));
+
+  return x;
+}
+
+// runtime parameterized version (uses xorshift_mul_3_32_gen)
+uint32_t xorshift_mul_3_32(uint32_t x)
+{
+  return build_xorshift_mul_3_32(x, &xorshift_mul_3_32_gen);
+}
+
+// batch of the runtime slot. parameters by value (see fxsm3_batch)
+hot_kernel static void fxsm3_32_batch(uint64_t* d, const uint64_t* s, size_t n, const xorshift_mul_3_32_t p)
+{
+  for(size_t i=0; i<n; i++) d[i] = build_xorshift_mul_3_32((uint32_t)s[i], &p);
+}
+
+void xorshift_mul_3_32_batch(uint64_t* d, const uint64_t* s, size_t n)
+{
+  fxsm3_32_batch(d, s, n, xorshift_mul_3_32_gen);
+}
+
+enum {
+  murmur3_32,   // https://github.com/aappleby/smhasher/wiki/MurmurHash3
+  xxhash_32,
+  lowbias32     // https://nullprogram.com/blog/2018/07/31/
+};
+
+uint32_t fmurmur3_32(uint32_t x);
+uint32_t fxxhash_32 (uint32_t x);
+uint32_t flowbias32 (uint32_t x);
+
+void fmurmur3_32_batch(uint64_t* d, const uint64_t* s, size_t n);
+void fxxhash_32_batch (uint64_t* d, const uint64_t* s, size_t n);
+void flowbias32_batch (uint64_t* d, const uint64_t* s, size_t n);
+
+const xorshift_mul_3_32_t xorshift_mul_3_32_def[] =
+{
+  {.s0=16, .m0=0x85ebca6b, .s1=13, .m1=0xc2b2ae35, .s2=16, .name="murmur3_32", .f=fmurmur3_32, .b=fmurmur3_32_batch},
+  {.s0=15, .m0=0x85ebca77, .s1=13, .m1=0xc2b2ae3d, .s2=16, .name="xxhash_32",  .f=fxxhash_32,  .b=fxxhash_32_batch},
+  {.s0=16, .m0=0x7feb352d, .s1=15, .m1=0x846ca68b, .s2=16, .name="lowbias32",  .f=flowbias32,  .b=flowbias32_batch},
+};
+
+const uint32_t xorshift_mul_3_32_def_len = LENGTHOF(xorshift_mul_3_32_def);
+
+uint32_t fmurmur3_32(uint32_t x) { return build_xorshift_mul_3_32(x, xorshift_mul_3_32_def+murmur3_32); }
+uint32_t fxxhash_32 (uint32_t x) { return build_xorshift_mul_3_32(x, xorshift_mul_3_32_def+xxhash_32);  }
+uint32_t flowbias32 (uint32_t x) { return build_xorshift_mul_3_32(x, xorshift_mul_3_32_def+lowbias32);  }
+
+// the batch versions: the constants fold like the 64-bit (XSM3_BATCH)
+#define XSM3_32_BATCH(F) \
+  hot_kernel void F ## _batch(uint64_t* d, const uint64_t* s, size_t n) { for(size_t i=0; i<n; i++) d[i] = F((uint32_t)s[i]); }
+
+XSM3_32_BATCH(fmurmur3_32) XSM3_32_BATCH(fxxhash_32) XSM3_32_BATCH(flowbias32)
+
+// shift amount 's' of a 64-bit definition scaled to 'bits' (rounded and
+// clamped to [1,bits-1])
+uint8_t xorshift_mul_3_scale_shift(uint32_t s, uint32_t bits)
+{
+  s = (s*bits + 32) >> 6;
+
+  if (s == 0)    s = 1;
+  if (s >= bits) s = bits-1;
+
+  return (uint8_t)s;
+}
+
+// 32-bit analog of a 64-bit definition: shifts scaled and multipliers
+// truncated (forced odd). makes no claim about quality.
+void xorshift_mul_3_to_32(xorshift_mul_3_32_t* d, const xorshift_mul_3_t* s)
+{
+  d->s0 = xorshift_mul_3_scale_shift(s->s0, 32);
+  d->s1 = xorshift_mul_3_scale_shift(s->s1, 32);
+  d->s2 = xorshift_mul_3_scale_shift(s->s2, 32);
+  d->m0 = (uint32_t)s->m0 | 1;
+  d->m1 = (uint32_t)s->m1 | 1;
+  d->f  = xorshift_mul_3_32;
+  d->b  = xorshift_mul_3_32_batch;
+}
+
+void pretty_print_xorshift_mul_3_32(const xorshift_mul_3_32_t* def, uint32_t indent)
+{
+  printf("%*suint32_t %s(uint32_t x)\n"
+	 "%*s{\n"
+	 "%*s  x = (x ^ (x >> %2u)) * 0x%08x;\n"
+	 "%*s  x = (x ^ (x >> %2u)) * 0x%08x;\n"
+	 "%*s  x = (x ^ (x >> %2u));\n"
+	 "%*s  return x;\n"
+	 "%*s}\n",
+	 indent,"",def->name,
+	 indent,"",
+	 indent,"",def->s0,def->m0,
+	 indent,"",def->s1,def->m1,
+	 indent,"",def->s2,
+	 indent,"",
+	 indent,"");
+}
+
+void print_xorshift_mul_3_32(void)
+{
+  printf("{%s", xorshift_mul_3_32_def[0].name);
+  for(uint32_t i=1; i<LENGTHOF(xorshift_mul_3_32_def); i++) {
+    printf(",%s", xorshift_mul_3_32_def[i].name);
+  }
+  printf("} + scaled versions of: ");
+  print_xorshift_mul_3();
+}
+
+const xorshift_mul_3_32_t* xorshift_mul_3_32_current = NULL;
+
+// native 32-bit table first and then the 32-bit analog of a 64-bit entry
+hash32_t* get_hash32(char* name)
+{
+  static char scaled_name[64];
+
+  for(uint32_t i=0; i<LENGTHOF(xorshift_mul_3_32_def); i++) {
+    if (strcmp(name,xorshift_mul_3_32_def[i].name) == 0) {
+      xorshift_mul_3_32_current = xorshift_mul_3_32_def+i;
+      bit_finalizer_32   = xorshift_mul_3_32_def[i].f;
+      bit_finalizer_32_batch = xorshift_mul_3_32_def[i].b;
+      bit_finalizer_name = name;
+      bit_finalizer_type = hash_type_xsm3_32;
+      return bit_finalizer_32;
+    }
+  }
+
+  if (get_xorshift_mul_3(name)) {
+    snprintf(scaled_name, sizeof(scaled_name), "%s_32", name);
+    xorshift_mul_3_to_32(&xorshift_mul_3_32_gen, xorshift_mul_3_current);
+    xorshift_mul_3_32_gen.name = scaled_name;
+    xorshift_mul_3_32_current  = &xorshift_mul_3_32_gen;
+    bit_finalizer_32   = xorshift_mul_3_32_gen.f;
+    bit_finalizer_32_batch = xorshift_mul_3_32_gen.b;
+    bit_finalizer_name = scaled_name;
+    bit_finalizer_type = hash_type_xsm3_32;
+    return bit_finalizer_32;
+  }
+
+  fprintf(stderr, "warning: 32-bit hash %s not found\n", name);
+
+  return NULL;
+}
+
+
+void bit_finalizer_pretty_print(void)
+{
+}
+
+//*****************************************************************************
+
+uint64_t fnv_64(const void* data, size_t n, uint64_t h)
+{
+  const uint8_t* p = (const uint8_t*)data;
+
+  for(size_t i=0; i<n; i++) { h ^= p[i]; h *= UINT64_C(0x100000001b3); }
+
+  return h;
+}
+
+uint64_t get_timestamp(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// value of a 'key N' line in a mini_testu01 --demand table. zero on failure
+uint64_t demand_table_value(char* filename, char* key)
+{
+  FILE*    file = fopen(filename, "r");
+  size_t   len  = strlen(key);
+  uint64_t v    = 0;
+  char     line[256];
+
+  if (!file) {
+    fprintf(stderr, "error: couldn't open '%s'\n", filename);
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, key, len) == 0 && line[len] == ' ')
+      v = strtoul(line+len+1, NULL, 0);
+  }
+
+  fclose(file);
+
+  return v;
+}
+
+
+//*****************************************************************************
+// hardware performance counters (Linux perf_event_open). Each counter is
+// opened independently for this thread (user mode only). Any that can't
+// be opened (VM w/o PMU passthru, perf_event_paranoid, etc) are marked
+// invalid and read as zero. When the kernel allows it the counters are
+// read in user mode (rdpmc) so they can be sampled in the generator
+// refill without a syscall pair per refill.
+
+bool perf_counter_valid[perf_counter_length] = {0};
+
+char* perf_counter_name[perf_counter_length] = {
+  [perf_cycles]       = "cycles",
+  [perf_instructions] = "instructions",
+  [perf_branch_miss]  = "branch-miss",
+  [perf_cache_miss]   = "cache-miss",
+};
+
+#if defined(__linux__)
+
+typedef struct {
+  int   fd;
+  struct perf_event_mmap_page* page;
+} perf_counter_t;
+
+static perf_counter_t perf_counter[perf_counter_length];
+
+static const uint64_t perf_counter_config[perf_counter_length] = {
+  [perf_cycles]       = PERF_COUNT_HW_CPU_CYCLES,
+  [perf_instructions] = PERF_COUNT_HW_INSTRUCTIONS,
+  [perf_branch_miss]  = PERF_COUNT_HW_BRANCH_MISSES,
+  [perf_cache_miss]   = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+// returns false if no counters could be opened
+bool perf_counters_open(void)
+{
+  uint32_t n = 0;
+  size_t   page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+  for(uint32_t i=0; i<perf_counter_length; i++) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = perf_counter_config[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+    perf_counter[i].fd   = fd;
+    perf_counter[i].page = NULL;
+
+    if (fd < 0) continue;
+
+    void* page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (page != MAP_FAILED)
+      perf_counter[i].page = page;
+
+    perf_counter_valid[i] = true;
+    n++;
+  }
+
+  return n != 0;
+}
+
+static inline uint64_t perf_counter_read_one(perf_counter_t* c)
+{
+  uint64_t v = 0;
+
+#if defined(__x86_64__)
+  struct perf_event_mmap_page* pc = c->page;
+
+  if (pc && pc->cap_user_rdpmc) {
+    uint32_t seq, idx;
+
+    // seqlock protocol from linux/perf_event.h
+    do {
+      seq = pc->lock;
+      __asm__ volatile("" ::: "memory");
+      idx = pc->index;
+      v   = (uint64_t)pc->offset;
+
+      if (idx) {
+	uint32_t w = pc->pmc_width;
+	uint64_t p = (uint64_t)__builtin_ia32_rdpmc((int)idx-1);
+	p <<= 64-w;
+	v  += (uint64_t)((int64_t)p >> (64-w));
+      }
+      __asm__ volatile("" ::: "memory");
+    } while (pc->lock != seq);
+
+    if (idx) return v;
+  }
+#endif
+
+  if (read(c->fd, &v, sizeof(v)) != sizeof(v)) v = 0;
+
+  return v;
+}
+
+void perf_counters_read(perf_counts_t* c)
+{
+  for(uint32_t i=0; i<perf_counter_length; i++)
+    c->v[i] = perf_counter_valid[i] ? perf_counter_read_one(perf_counter+i) : 0;
+}
+
+#else
+
+bool perf_counters_open(void) { return false; }
+void perf_counters_read(perf_counts_t* c) { memset(c, 0, sizeof(*c)); }
+
+#endif
+
+// a += (e-s)
+void perf_counts_accum(perf_counts_t* a, const perf_counts_t* e, const perf_counts_t* s)
+{
+  for(uint32_t i=0; i<perf_counter_length; i++)
+    a->v[i] += e->v[i] - s->v[i];
 }
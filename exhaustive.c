@@ -0,0 +1,412 @@
+// Marc B. Reynolds, 2022-2025
+// Public Domain under http://unlicense.org, see link for details.
+
+// Exhaustive checks of reduced width (32 & 16-bit) analogs of the
+// 3 stage xorshift/multiply finalizers. At 64-bit we can only sample
+// but at 32-bit the entire input space is small enough to:
+// 1) verify the function is a bijection by marking every output in
+//    a bitmap (2^32 bits = 512MB) and counting repeats.
+// 2) compute the exact single bit flip (avalanche) probabilities over
+//    the full domain instead of an estimate.
+//
+// The analog of a 64-bit definition has its shifts scaled by the
+// width ratio and its multipliers truncated (and forced odd). This
+// isn't claiming any quality relation between the two. It's for
+// sanity checking the shape of hand-tuned variants.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include "mini_testu01.h"
+
+//*****************************************************************************
+
+// reduced width parameter set
+typedef struct {
+  uint32_t m0,m1;
+  uint8_t  s0,s1,s2;
+  uint32_t bits;
+  uint32_t mask;
+  char*    name;
+} xsm3_n_t;
+
+static inline_always uint32_t xsm3_n(uint32_t x, const xsm3_n_t* const p)
+{
+  uint32_t mask = p->mask;
+  uint32_t m0   = p->m0;
+  uint32_t m1   = p->m1;
+  uint32_t s0   = p->s0;
+  uint32_t s1   = p->s1;
+  uint32_t s2   = p->s2;
+
+  x = ((x ^ (x >> s0)) * m0) & mask;
+  x = ((x ^ (x >> s1)) * m1) & mask;
+  x = ((x ^ (x >> s2)));
+
+  return x;
+}
+
+// reduced width analog of a 64-bit definition
+static void xsm3_n_from_64(xsm3_n_t* p, const xorshift_mul_3_t* def, uint32_t bits)
+{
+  p->bits = bits;
+  p->mask = (uint32_t)((UINT64_C(1) << bits)-1);
+  p->s0   = xorshift_mul_3_scale_shift(def->s0, bits);
+  p->s1   = xorshift_mul_3_scale_shift(def->s1, bits);
+  p->s2   = xorshift_mul_3_scale_shift(def->s2, bits);
+  p->m0   = ((uint32_t)def->m0 & p->mask) | 1;
+  p->m1   = ((uint32_t)def->m1 & p->mask) | 1;
+  p->name = def->name;
+}
+
+static void xsm3_n_print(const xsm3_n_t* p)
+{
+  uint32_t d = p->bits >> 2;
+
+  printf("  uint%u_t %s_%u(uint%u_t x)\n"
+	 "  {\n"
+	 "    x = (x ^ (x >> %2u)) * 0x%0*x;\n"
+	 "    x = (x ^ (x >> %2u)) * 0x%0*x;\n"
+	 "    x = (x ^ (x >> %2u));\n"
+	 "    return x;\n"
+	 "  }\n",
+	 p->bits, p->name, p->bits, p->bits,
+	 p->s0, d, p->m0,
+	 p->s1, d, p->m1,
+	 p->s2);
+}
+
+//*****************************************************************************
+// bijection check: set a bit per output. an already set bit is a repeat.
+// The bitmap is far larger than cache so the marking is memory bound.
+// Outputs are computed in small blocks with the target words prefetched
+// to keep multiple misses in flight.
+
+#define BIJECTION_BLOCK 32
+
+typedef struct {
+  uint64_t repeats;     // number of inputs that hit an already marked output
+  uint32_t example;     // one repeated output (if any)
+  uint32_t pre[2];      // two inputs that map to 'example'
+} bijection_t;
+
+static uint64_t* bitmap = NULL;
+
+// 2MB aligned so the kernel can back it with huge pages. The marking
+// is a random walk over 512MB which otherwise is a TLB miss per output.
+static uint64_t* bitmap_alloc(size_t bytes)
+{
+  size_t    align = (bytes >= (1u<<21)) ? (1u<<21) : 64;
+  uint64_t* p     = aligned_alloc(align, bytes);
+
+#if defined(MADV_HUGEPAGE)
+  if (p && align > 64) madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+
+  return p;
+}
+
+static void bijection_check(const xsm3_n_t* p, bijection_t* r)
+{
+  uint64_t n       = (uint64_t)p->mask + 1;
+  size_t   words   = (size_t)((n+63) >> 6);
+  uint64_t nblk    = (n + BIJECTION_BLOCK-1)/BIJECTION_BLOCK;
+  uint64_t repeats = 0;
+  uint32_t example = 0;
+
+  memset(bitmap, 0, words*sizeof(uint64_t));
+
+  #pragma omp parallel for schedule(static) reduction(+:repeats)
+  for(uint64_t blk=0; blk<nblk; blk++) {
+    uint32_t h[BIJECTION_BLOCK];
+    uint64_t s = blk*BIJECTION_BLOCK;
+    uint32_t e = (uint32_t)((s+BIJECTION_BLOCK < n) ? BIJECTION_BLOCK : n-s);
+
+    for(uint32_t i=0; i<e; i++) {
+      h[i] = xsm3_n((uint32_t)(s+i), p);
+      __builtin_prefetch(bitmap + (h[i] >> 6), 1);
+    }
+
+    for(uint32_t i=0; i<e; i++) {
+      uint64_t b = UINT64_C(1) << (h[i] & 63);
+      uint64_t o = __atomic_fetch_or(bitmap + (h[i] >> 6), b, __ATOMIC_RELAXED);
+
+      if (o & b) {
+        repeats++;
+        __atomic_store_n(&example, h[i], __ATOMIC_RELAXED);
+      }
+    }
+  }
+
+  r->repeats = repeats;
+  r->example = example;
+
+  if (repeats == 0) return;
+
+  // walk again to find the first two preimages of the example
+  uint32_t c = 0;
+
+  for(uint64_t i=0; i<n && c<2; i++) {
+    if (xsm3_n((uint32_t)i, p) == example)
+      r->pre[c++] = (uint32_t)i;
+  }
+}
+
+//*****************************************************************************
+// avalanche: for each input bit 'i' count how many times output bit 'j'
+// flips over the entire domain (sac_acc_t in common.c).
+
+static sac_acc_t sac;
+
+static void sac_check(const xsm3_n_t* p)
+{
+  uint64_t n    = (uint64_t)p->mask + 1;
+  uint32_t bits = p->bits;
+
+  sac_acc_clear(&sac);
+
+  #pragma omp parallel
+  {
+    sac_acc_t* acc = malloc(sizeof(sac_acc_t));
+    uint64_t   d[32];
+
+    if (!acc) {
+      print_error("avalanche allocation failed");
+      exit(-1);
+    }
+
+    sac_acc_clear(acc);
+
+    #pragma omp for schedule(static)
+    for(uint64_t x=0; x<n; x++) {
+      uint32_t h = xsm3_n((uint32_t)x, p);
+
+      for(uint32_t i=0; i<bits; i++)
+	d[i] = h ^ xsm3_n((uint32_t)x ^ (1u << i), p);
+
+      sac_acc_row(acc, d, bits);
+    }
+
+    #pragma omp critical
+    sac_acc_merge(&sac, acc);
+
+    free(acc);
+  }
+}
+
+bool sac_matrix = false;
+
+static void sac_report(const xsm3_n_t* p)
+{
+  double   scale = 1.0/((double)p->mask + 1.0);
+  uint32_t bits  = p->bits;
+  double   peak  = 0.0;
+  double   sum   = 0.0;
+  double   sum2  = 0.0;
+  uint32_t pi    = 0;
+  uint32_t pj    = 0;
+
+  for(uint32_t i=0; i<bits; i++) {
+    for(uint32_t j=0; j<bits; j++) {
+      double b = (double)sac.total[i][j]*scale - 0.5;
+      double a = fabs(b);
+      sum  += a;
+      sum2 += b*b;
+      if (a > peak) { peak = a; pi = i; pj = j; }
+    }
+  }
+
+  double k = 1.0/(double)(bits*bits);
+
+  printf("  avalanche bias: max = %f (in bit %2u -> out bit %2u), mean = %f, rms = %f\n",
+	 peak, pi, pj, sum*k, sqrt(sum2*k));
+
+  if (!sac_matrix) return;
+
+  // rows: input bit, cols: output bit. bias in 1/1000 units
+  printf("  bias x 1000 (row = flipped input bit, col = output bit)\n");
+  for(uint32_t i=0; i<bits; i++) {
+    printf("  %2u:", i);
+    for(uint32_t j=0; j<bits; j++) {
+      double b = (double)sac.total[i][j]*scale - 0.5;
+      printf(" %4.0f", 1000.0*b);
+    }
+    printf("\n");
+  }
+}
+
+//*****************************************************************************
+
+bool     sac_enabled = true;
+uint32_t width       = 32;
+
+static void exhaustive(const xsm3_n_t* p)
+{
+  bijection_t r  = {0};
+  uint64_t    t0 = get_timestamp();
+
+  printf("%s (%u-bit)\n", p->name, p->bits);
+  xsm3_n_print(p);
+
+  bijection_check(p, &r);
+
+  if (r.repeats == 0)
+    printf("  bijection:      yes\n");
+  else {
+    printf("  bijection:      NO. %lu repeated outputs (image size = %lu)\n",
+	   r.repeats, (uint64_t)p->mask + 1 - r.repeats);
+    printf("  example:        f(0x%0*x) = f(0x%0*x) = 0x%0*x\n",
+	   p->bits >> 2, r.pre[0], p->bits >> 2, r.pre[1], p->bits >> 2, r.example);
+  }
+
+  if (sac_enabled) {
+    sac_check(p);
+    sac_report(p);
+  }
+
+  printf("  time:           %f sec\n\n", (double)(get_timestamp()-t0)*1e-9);
+}
+
+
+void help_options(char* name)
+{
+  printf("Usage: %s [OPTIONS]\n", name);
+  printf("\n"
+	 "  reduced width analogs of the xorshift/multiply finalizers\n"
+	 "    --bits=VALUE     32 (default) or 16\n"
+	 "    --hash=NAME      scaled version of built-in (default is all)\n"
+	 "    --xsm3=LIST      s0,m0,s1,m1,s2 used directly at the reduced width\n"
+	 "  avalanche:\n"
+	 "    --nosac          bijection check only\n"
+	 "    --matrix         dump the full bias matrix\n"
+	 "  other:\n"
+	 "    --help           \n"
+	 "\n");
+
+  exit(0);
+}
+
+int main(int argc, char** argv)
+{
+  static struct option long_options[] = {
+    {"bits",       required_argument, 0, 'b'},
+    {"hash",       optional_argument, 0, 'h'},
+    {"xsm3",       required_argument, 0, 'x'},
+    {"nosac",      no_argument,       0, 'n'},
+    {"matrix",     no_argument,       0, 'm'},
+    {"help",       optional_argument, 0, '?'},
+    {0,            0,                 0,  0 }
+  };
+
+  const xorshift_mul_3_t* def = NULL;
+  bool gen = false;
+  int  c;
+
+  while (1) {
+    int option_index = 0;
+
+    c = getopt_long(argc, argv, "", long_options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 'b':
+      width = (uint32_t)strtoul(optarg, NULL, 0);
+      if (width != 32 && width != 16) {
+	print_error("--bits must be 32 or 16");
+	return -1;
+      }
+      break;
+
+    case 'h':
+      if (optarg) {
+	if (get_xorshift_mul_3(optarg)) {
+	  def = xorshift_mul_3_current;
+	  break;
+	}
+	fprintf(stderr, "error: hash %s not found\n", optarg);
+	return -1;
+      }
+      print_xorshift_mul_3();
+      return 0;
+
+    case 'x':
+      if (parse_xorshift_mul_3(optarg, &xorshift_mul_3_gen)) {
+	gen = true;
+	break;
+      }
+      print_error("--xsm3 expects s0,m0,s1,m1,s2");
+      return -1;
+
+    case 'n': sac_enabled = false;     break;
+    case 'm': sac_matrix  = true;      break;
+    case '?': help_options(argv[0]);   break;
+
+    default:
+      printf("internal error: what option? %c (%u)\n", c,c);
+    }
+  }
+
+  bitmap = bitmap_alloc(((size_t)1 << width) >> 3);
+
+  if (!bitmap) {
+    print_error("bitmap allocation failed");
+    return -1;
+  }
+
+#if defined(_OPENMP)
+  printf("threads: %d\n\n", omp_get_max_threads());
+#endif
+
+  xsm3_n_t p;
+
+  if (gen) {
+    const xorshift_mul_3_t* g = &xorshift_mul_3_gen;
+
+    // directly specified: no scaling but must fit
+    if (g->s0 >= width || g->s1 >= width || g->s2 >= width) {
+      print_error("--xsm3 shift too large for width");
+      return -1;
+    }
+
+    p.bits = width;
+    p.mask = (uint32_t)((UINT64_C(1) << width)-1);
+    p.s0   = g->s0;
+    p.s1   = g->s1;
+    p.s2   = g->s2;
+    p.m0   = (uint32_t)g->m0 & p.mask;
+    p.m1   = (uint32_t)g->m1 & p.mask;
+    p.name = g->name;
+
+    if (p.m0 != g->m0 || p.m1 != g->m1)
+      print_warning("--xsm3 multiplier(s) truncated to width");
+
+    exhaustive(&p);
+  }
+  else if (def) {
+    xsm3_n_from_64(&p, def, width);
+    exhaustive(&p);
+  }
+  else {
+    for(uint32_t i=0; i<xorshift_mul_3_def_len; i++) {
+      xsm3_n_from_64(&p, xorshift_mul_3_def+i, width);
+      exhaustive(&p);
+    }
+  }
+
+  free(bitmap);
+
+  return 0;
+}
@@ -229,10 +229,51 @@ static inline uint64_t bit_parity_mask_64(uint64_t x) { return -bit_parity_64(x)
 // scatter/gather ops generically...skipping that ATM.
 // "Hacker's Delight" et al. call scatter/gather expand/compress
 #if (BITOPS_HAS_SCATTER_GATHER)
+#if !(defined(BITOPS_INTEL) && defined(__GNUC__) && !defined(__BMI2__))
 static inline uint32_t bit_scatter_32(uint32_t x, uint32_t m) { return _pdep_u32(x, m); } 
 static inline uint64_t bit_scatter_64(uint64_t x, uint64_t m) { return _pdep_u64(x, m); } 
 static inline uint32_t bit_gather_32(uint32_t x, uint32_t m)  { return _pext_u32(x, m); } 
 static inline uint64_t bit_gather_64(uint64_t x, uint64_t m)  { return _pext_u64(x, m); }
+#else
+// target without BMI2 (portable build): pdep/pext when the running CPU
+// has them otherwise a set bit of the mask at a time. picked once at
+// startup by the program (common.c: bitops_dispatch)
+#define BITOPS_BMI2 __attribute__((target("bmi2")))
+#define BITOPS_SCATTER_GATHER_DISPATCH
+
+BITOPS_BMI2 static inline uint64_t bit_scatter_64_bmi2(uint64_t x, uint64_t m) { return _pdep_u64(x, m); }
+BITOPS_BMI2 static inline uint64_t bit_gather_64_bmi2(uint64_t x, uint64_t m)  { return _pext_u64(x, m); }
+
+static inline uint64_t bit_scatter_64_sw(uint64_t x, uint64_t m)
+{
+  uint64_t r = 0;
+
+  for(; m != 0; x >>= 1, m &= m-1)
+    r |= (x & 1) ? (m & (~m+1)) : 0;
+
+  return r;
+}
+
+static inline uint64_t bit_gather_64_sw(uint64_t x, uint64_t m)
+{
+  uint64_t r = 0;
+  uint64_t b = 1;
+
+  for(; m != 0; b <<= 1, m &= m-1)
+    r |= (x & m & (~m+1)) ? b : 0;
+
+  return r;
+}
+
+extern uint64_t (*bit_scatter_64_f)(uint64_t, uint64_t);
+extern uint64_t (*bit_gather_64_f)(uint64_t, uint64_t);
+
+static inline uint64_t bit_scatter_64(uint64_t x, uint64_t m) { return bit_scatter_64_f(x,m); }
+static inline uint64_t bit_gather_64(uint64_t x, uint64_t m)  { return bit_gather_64_f(x,m);  }
+
+static inline uint32_t bit_scatter_32(uint32_t x, uint32_t m) { return (uint32_t)bit_scatter_64(x,m); }
+static inline uint32_t bit_gather_32(uint32_t x, uint32_t m)  { return (uint32_t)bit_gather_64(x,m); }
+#endif
 
 // add reference
 static inline uint64_t bit_permute_sg_step_64(uint64_t x, uint64_t m0, uint64_t m1)
@@ -444,6 +485,79 @@ static inline uint64_t bit_reverse_64(uint64_t x)
 }
 #endif
 
+// bit reverse 'n' values of 's' into 'd' (can be the same array)
+// * GFNI: an affine transform reverses the bits of each byte and a
+//   byte shuffle the order of the bytes
+// * AVX2: bits of the bytes by a nibble LUT (pshufb) then byte shuffle
+// * otherwise: scalar 'bit_reverse_64'
+// on x86 the variants are built regardless of the target and the best
+// the running CPU supports is picked once at startup by the program
+// (common.c: bitops_dispatch)
+static inline void bit_reverse_array_64_scalar(uint64_t* d, const uint64_t* s, size_t n)
+{
+  for(size_t i=0; i<n; i++) d[i] = bit_reverse_64(s[i]);
+}
+
+#if defined(BITOPS_INTEL) && defined(__GNUC__)
+__attribute__((target("avx512f,avx512bw,gfni")))
+static inline void bit_reverse_array_64_gfni(uint64_t* d, const uint64_t* s, size_t n)
+{
+  const __m512i a = _mm512_set1_epi64((int64_t)0x8040201008040201);
+  const __m512i b = _mm512_broadcast_i32x4(_mm_set_epi8(8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7));
+
+  size_t e = n & ~(size_t)7;
+  size_t i = 0;
+
+  for(; i<e; i += 8) {
+    __m512i x = _mm512_loadu_si512(s+i);
+    x = _mm512_gf2p8affine_epi64_epi8(x, a, 0);
+    x = _mm512_shuffle_epi8(x, b);
+    _mm512_storeu_si512(d+i, x);
+  }
+
+  for(; i<n; i++) d[i] = bit_reverse_64(s[i]);
+}
+
+__attribute__((target("avx2")))
+static inline void bit_reverse_array_64_avx2(uint64_t* d, const uint64_t* s, size_t n)
+{
+  const __m256i m  = _mm256_set1_epi8(0x0f);
+  const __m256i lo = _mm256_broadcastsi128_si256(_mm_set_epi8(
+		       (char)0xf0,0x70,(char)0xb0,0x30,(char)0xd0,0x50,(char)0x90,0x10,
+		       (char)0xe0,0x60,(char)0xa0,0x20,(char)0xc0,0x40,(char)0x80,0x00));
+  const __m256i hi = _mm256_broadcastsi128_si256(_mm_set_epi8(
+		       0x0f,0x07,0x0b,0x03,0x0d,0x05,0x09,0x01,0x0e,0x06,0x0a,0x02,0x0c,0x04,0x08,0x00));
+  const __m256i b  = _mm256_broadcastsi128_si256(_mm_set_epi8(8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7));
+
+  size_t e = n & ~(size_t)3;
+  size_t i = 0;
+
+  for(; i<e; i += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(s+i));
+    __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, m));
+    __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(x,4), m));
+    x = _mm256_shuffle_epi8(_mm256_or_si256(l,h), b);
+    _mm256_storeu_si256((__m256i*)(d+i), x);
+  }
+
+  for(; i<n; i++) d[i] = bit_reverse_64(s[i]);
+}
+
+#define BITOPS_REVERSE_ARRAY_DISPATCH
+
+extern void (*bit_reverse_array_64_f)(uint64_t*, const uint64_t*, size_t);
+
+static inline void bit_reverse_array_64(uint64_t* d, const uint64_t* s, size_t n)
+{
+  bit_reverse_array_64_f(d,s,n);
+}
+#else
+static inline void bit_reverse_array_64(uint64_t* d, const uint64_t* s, size_t n)
+{
+  bit_reverse_array_64_scalar(d,s,n);
+}
+#endif
+
 
 // single set bit in the position of lowest set in 'x' (intel: blsi)
 static inline uint32_t bit_lowest_set_32(uint32_t x)   { return x & (-x); }
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <getopt.h>
 #include <fcntl.h>
@@ -15,15 +16,15 @@
 #include "mini_testu01.h"
 
 //*****************************************************************************
-// default compile time buffer size is 1K which seems small enough to
-// buid small files for fast spot checks and enough granularity for
-// everything else.
+// default compile time buffer size is 8K. the last buffer is truncated
+// so it doesn't limit the granularity of the file size and it's long
+// enough for the batched SAC fill to amortize the per buffer work.
 //
 // SAC_BUFFER_LEN:   number of 64-bit SAC samples in buffer
 // SEQ_BUFFER_LEN:   number of 64-bit integers in buffer
 // BUFFER_SIZE:      size in bytes of buffer
 
-#define  SAC_BUFFER_LEN  (2)
+#define  SAC_BUFFER_LEN  (16)
 #define  SEQ_BUFFER_LEN  (64*SAC_BUFFER_LEN)
 #define  BUFFER_SIZE     ( 8*SEQ_BUFFER_LEN)
 uint64_t buffer[SEQ_BUFFER_LEN];
@@ -74,22 +75,49 @@ static inline_always uint64_t pcg_next(state_t* state)
 // recurrence with simple increment value as that will generate many
 // repeated output values in buffer causing statistical tests (to
 // properly) fail.
-static inline_always void sac_buffer_fill(uint64_t (*sample)(state_t*))
+//
+// The flips of a row only differ by a known mask so they're laid out
+// as one batch: the finalizer is evaluated by its (vectorized) batch
+// version in place and 'h' is folded into each row after.
+
+// row 'i' of 'd' = the 64 single bit flips of x[i]. the flip masks are
+// a table so a row is 8 (AVX-512) or 16 (AVX2) broadcast/xor/stores with
+// the masks held in registers.
+hot_kernel static void sac_fanout(uint64_t* d, const uint64_t* x, uint32_t n)
 {
-  for(uint32_t n=0; n<SAC_BUFFER_LEN; n++) {
-    uint64_t x = sample(&sample_state);      // x = u_n
-    uint64_t h = bit_finalizer(x);           // h = hash(x)
-    uint64_t b = 1;                          // b = 2^p  (p=0)
-    uint32_t c = 0;                          // c = output index
-
-    hint_unroll(8)
-    for(uint32_t p=0; p<64; p++) {
-      buffer[c++] = h ^ bit_finalizer(x^b);
-      b <<= 1;
-    }
+  uint64_t b[64];
+
+  for(uint32_t p=0; p<64; p++) b[p] = UINT64_C(1) << p;
+
+  for(uint32_t i=0; i<n; i++, d+=64) {
+    const uint64_t v = x[i];
+    for(uint32_t p=0; p<64; p++) d[p] = v ^ b[p];
+  }
+}
+
+// row 'i' of 'd' ^= h[i]
+hot_kernel static void sac_fold(uint64_t* d, const uint64_t* h, uint32_t n)
+{
+  for(uint32_t i=0; i<n; i++, d+=64) {
+    const uint64_t v = h[i];
+    for(uint32_t p=0; p<64; p++) d[p] ^= v;
   }
 }
 
+static inline_always void sac_buffer_fill(uint64_t (*sample)(state_t*))
+{
+  uint64_t x[SAC_BUFFER_LEN];                // x = u_n
+  uint64_t h[SAC_BUFFER_LEN];                // h = hash(x)
+
+  for(uint32_t n=0; n<SAC_BUFFER_LEN; n++)
+    x[n] = sample(&sample_state);
+
+  sac_fanout(buffer, x, SAC_BUFFER_LEN);
+  bit_finalizer_batch(buffer, buffer, SEQ_BUFFER_LEN);
+  bit_finalizer_batch(h, x, SAC_BUFFER_LEN);
+  sac_fold(buffer, h, SAC_BUFFER_LEN);
+}
+
 // fills buffer with hash(u_n)
 static inline_always void seq_buffer_fill(uint64_t (*sample)(state_t*))
 {
@@ -102,18 +130,177 @@ static inline_always void seq_buffer_fill(uint64_t (*sample)(state_t*))
   }
 }
 
-static inline_always void sac_buffer_fill_lds(void) { seq_buffer_fill(lds_next); }
-static inline_always void sac_buffer_fill_lcg(void) { seq_buffer_fill(lcg_next); }
-static inline_always void sac_buffer_fill_pcg(void) { seq_buffer_fill(pcg_next); }
+//*****************************************************************************
+// rows: h ^ hash((x + a_k) ^ m_k) for each 'x' of the base sequence over
+// a table of deltas. for --sac2 the masks are the 2016 two bit flips
+// b_i^b_j (i<j) or a sampled subset (no a_k). for --delta the user's
+// list. a buffer is ROW_CHUNKS chunks of rows (~2K values each) and the
+// rows are independent so the chunks are built in parallel: a fan-out,
+// an in place batch hash and a fold of 'h'.
+
+#define  ROW_CHUNKS   16
+#define  ROW_CHUNK    2048
+
+uint64_t* row_add;                          // a_k (NULL if all zero)
+uint64_t* row_mask;                         // m_k
+uint32_t  row_len;                          // number of deltas (row length)
+uint32_t  row_chunk;                        // rows per chunk
+uint32_t  row_samples;                      // rows per buffer
+uint64_t* row_buffer;
+uint64_t* row_x;                            // x = u_n of the buffer
+uint64_t* row_h;                            // h = hash(x)
+
+// a single delta (row length one) is special cased so the loops are
+// across rows and vectorize
+
+// row 'i' of 'd' = x[i] ^ m[k] for 'n' rows
+hot_kernel static void row_fanout(uint64_t* d, const uint64_t* x, uint32_t n, const uint64_t* m, uint32_t len)
+{
+  if (len == 1) {
+    const uint64_t mk = m[0];
+    for(uint32_t i=0; i<n; i++) d[i] = x[i] ^ mk;
+    return;
+  }
+
+  for(uint32_t i=0; i<n; i++, d+=len) {
+    const uint64_t v = x[i];
+    for(uint32_t k=0; k<len; k++) d[k] = v ^ m[k];
+  }
+}
+
+// row 'i' of 'd' = (x[i] + a[k]) ^ m[k] for 'n' rows
+hot_kernel static void row_fanout_add(uint64_t* d, const uint64_t* x, uint32_t n, const uint64_t* a, const uint64_t* m, uint32_t len)
+{
+  if (len == 1) {
+    const uint64_t ak = a[0], mk = m[0];
+    for(uint32_t i=0; i<n; i++) d[i] = (x[i] + ak) ^ mk;
+    return;
+  }
+
+  for(uint32_t i=0; i<n; i++, d+=len) {
+    const uint64_t v = x[i];
+    for(uint32_t k=0; k<len; k++) d[k] = (v + a[k]) ^ m[k];
+  }
+}
+
+// row 'i' of 'd' ^= h[i] for 'n' rows
+hot_kernel static void row_fold(uint64_t* d, const uint64_t* h, uint32_t n, uint32_t len)
+{
+  if (len == 1) {
+    for(uint32_t i=0; i<n; i++) d[i] ^= h[i];
+    return;
+  }
+
+  for(uint32_t i=0; i<n; i++, d+=len) {
+    const uint64_t v = h[i];
+    for(uint32_t k=0; k<len; k++) d[k] ^= v;
+  }
+}
+
+// the deltas are set. size the buffer
+static void row_init(void)
+{
+  row_chunk   = (row_len < ROW_CHUNK) ? ROW_CHUNK/row_len : 1;
+  row_samples = ROW_CHUNKS*row_chunk;
+  row_buffer  = aligned_alloc(64, (size_t)row_samples*row_len*sizeof(uint64_t));
+  row_x       = malloc(row_samples*sizeof(uint64_t));
+  row_h       = malloc(row_samples*sizeof(uint64_t));
+
+  if (!row_buffer || !row_x || !row_h) {
+    print_error("allocation failed");
+    exit(-1);
+  }
+}
+
+static inline_always void row_buffer_fill(uint64_t (*sample)(state_t*))
+{
+  // local state: the stores to 'row_x' could otherwise alias it
+  state_t s = sample_state;
+
+  for(uint32_t n=0; n<row_samples; n++)
+    row_x[n] = sample(&s);
+
+  sample_state = s;
+
+  bit_finalizer_batch(row_h, row_x, row_samples);
+
+  #pragma omp parallel for schedule(static)
+  for(uint32_t c=0; c<ROW_CHUNKS; c++) {
+    uint32_t  r = c*row_chunk;
+    uint64_t* d = row_buffer + (size_t)r*row_len;
+
+    if (row_add)
+      row_fanout_add(d, row_x+r, row_chunk, row_add, row_mask, row_len);
+    else
+      row_fanout(d, row_x+r, row_chunk, row_mask, row_len);
+
+    bit_finalizer_batch(d, d, (size_t)row_chunk*row_len);
+    row_fold(d, row_h+r, row_chunk, row_len);
+  }
+}
+
+#define SAC2_PAIRS (64*63/2)
+
+// the two bit flip masks. all pairs in order (0,1),(0,2)..(62,63) or 'n'
+// of them: a fixed (same every run) pseudo-random subset
+static void sac2_masks(uint32_t n)
+{
+  uint64_t* m = malloc(SAC2_PAIRS*sizeof(uint64_t));
+  uint32_t  c = 0;
+
+  for(uint32_t i=0; i<63; i++)
+    for(uint32_t j=i+1; j<64; j++)
+      m[c++] = (UINT64_C(1) << i) ^ (UINT64_C(1) << j);
+
+  if (n < SAC2_PAIRS) {
+    // partial Fisher-Yates
+    for(uint32_t i=0; i<n; i++) {
+      uint32_t j = i + (uint32_t)(fmix13(i) % (SAC2_PAIRS-i));
+      uint64_t t = m[i]; m[i] = m[j]; m[j] = t;
+    }
+  }
+
+  row_mask = m;
+  row_len  = n;
+  row_init();
+}
+
+// --delta: the user's list. a_k is only used if there are any
+static void delta_masks(delta_t* d, uint32_t n)
+{
+  row_add  = NULL;
+  row_mask = malloc(n*sizeof(uint64_t));
+  row_len  = n;
+
+  for(uint32_t k=0; k<n; k++) {
+    row_mask[k] = d[k].mask;
+
+    if (d[k].add && !row_add) row_add = calloc(n, sizeof(uint64_t));
+  }
+
+  for(uint32_t k=0; row_add && k<n; k++) row_add[k] = d[k].add;
+
+  row_init();
+}
+
+static inline_always void sac_buffer_fill_lds(void) { sac_buffer_fill(lds_next); }
+static inline_always void sac_buffer_fill_lcg(void) { sac_buffer_fill(lcg_next); }
+static inline_always void sac_buffer_fill_pcg(void) { sac_buffer_fill(pcg_next); }
 
 static inline_always void seq_buffer_fill_lds(void) { seq_buffer_fill(lds_next); }
 
+static inline_always void row_buffer_fill_lds(void) { row_buffer_fill(lds_next); }
+static inline_always void row_buffer_fill_lcg(void) { row_buffer_fill(lcg_next); }
+static inline_always void row_buffer_fill_pcg(void) { row_buffer_fill(pcg_next); }
+
 //*****************************************************************************
 // builder to expand sampling & sequence choice
 
-size_t num_blocks = 1;
+// output size in bytes. the last buffer is truncated if not a multiple
+size_t num_bytes = 1024;
 
-static inline_always void create_file(const char* filename, void (*fill)(void))
+// 'fill' produces 'size' bytes at 'data' per call
+static inline_always void create_file(const char* filename, void (*fill)(void), const void* data, size_t size)
 {
   FILE*  file = fopen(filename, "wb");
   size_t t;
@@ -121,11 +308,13 @@ static inline_always void create_file(const char* filename, void (*fill)(void))
   if (file) {
     setvbuf(file, NULL, _IOFBF, BUFFER_SIZE);
 
-    for(size_t i=0; i<num_blocks; i++) {
+    for(size_t r=num_bytes; r!=0; r-=t) {
+      size_t n = (r < size) ? r : size;
       fill();
-      t = fwrite(buffer, 1, BUFFER_SIZE, file);
-      if (t == BUFFER_SIZE) continue;
+      t = fwrite(data, 1, n, file);
+      if (t == n) continue;
       // error handling should be here
+      break;
     }
 
     fflush(file);
@@ -144,30 +333,39 @@ static inline_always void create_file(const char* filename, void (*fill)(void))
 char* filename = "data.bin";
 
 enum { lds, lcg, pcg };
-enum { sac, seq      };
+enum { sac, seq, sac2, delta };
 
 uint32_t sample_type = lds;
 uint32_t fill_type   = sac;
+uint32_t sac2_len    = SAC2_PAIRS;
+char*    delta_list  = NULL;
 
 void help_options(char* name)
 {
   printf("Usage: %s [OPTIONS] FILE\n", name);
   printf("\n"
-	 "  output size to produce (default is "   " K)\n"
+	 "  output size to produce (default is 1K)\n"
 	 "    --kb=VALUE       kilobytes (2^10)\n"
 	 "    --mb=VALUE       megabytes (2^20)\n"
 	 "    --gb=VALUE       gigabytes (2^30)\n"
+	 "    --bytes=VALUE    exact number of bytes\n"
+	 "    --demand=FILE    exact size from a mini_testu01 --demand table\n"
 	 "  bit finalizer:     (default is internal)\n"
 	 "    --hash=NAME      built-in named hash (no param lists)\n"
 	 "  base sequence:     (default is lds)\n"
 	 "    --lds=[VALUE]    low    entropy (default VALUE=1)\n"
-	 "    --lcg            medium entropy (--sac only)\n"
-	 "    --pcg            high   entropy (--sac only)\n"
+	 "    --lcg            medium entropy (not --seq)\n"
+	 "    --pcg            high   entropy (not --seq)\n"
 	 "    --phi            shorthand: --lds=0x9e3779b97f4a7c15\n"
 	 "    --state=VALUE    initial state of the sequence\n"
 	 "  output type:\n"
 	 "    --sac            (default)\n"
 	 "    --seq            hash the base sequence\n"
+	 "    --sac2=[N]       two bit flips: h^hash(x^b_i^b_j) for all 2016\n"
+	 "                     pairs or N of them (a fixed sampled subset)\n"
+	 "    --delta=LIST     differentials: hash(x)^hash(x+d) for each d of\n"
+	 "                     LIST. items: VALUE (x+VALUE), ^VALUE (x^VALUE),\n"
+	 "                     inc or K*inc (the --lds/--phi increment)\n"
 	 "  other:\n"
 	 "    --help           \n"
 	 "\n");
@@ -190,8 +388,12 @@ int main(int argc, char** argv)
     {"kb",         required_argument, 0,  0},
     {"mb",         required_argument, 0,  1},
     {"gb",         required_argument, 0,  2},
+    {"bytes",      required_argument, 0,  8},
+    {"demand",     required_argument, 0,  9},
     {"sac",        no_argument,       0,  3},
     {"seq",        no_argument,       0,  4},
+    {"sac2",       optional_argument, 0, 10},
+    {"delta",      required_argument, 0, 11},
     {"lds",        optional_argument, 0,  5},
     {"lcg",        no_argument,       0,  6},
     {"pcg",        no_argument,       0,  7},
@@ -217,14 +419,42 @@ int main(int argc, char** argv)
     case 0: case 1: case 2:
       {
 	uint64_t v = parse_u64(optarg);
-	v <<= (10*c);
+	v <<= (10*(c+1));
 	if (v != 0)
-	  num_blocks = v;
+	  num_bytes = v;
+      }
+      break;
+
+    case 8: case 9:
+      {
+	uint64_t v = (c == 8) ? parse_u64(optarg) : demand_table_value(optarg, "bytes");
+	if (v != 0)
+	  num_bytes = v;
+	else {
+	  print_error("bad size");
+	  return -1;
+	}
       }
       break;
 
     case 3: case 4: fill_type = (uint32_t)(c-3); break;
 
+    case 11: fill_type = delta; delta_list = optarg; break;
+
+    case 10:
+      fill_type = sac2;
+      sac2_len  = SAC2_PAIRS;
+
+      if (optarg) {
+	uint64_t v = parse_u64(optarg);
+
+	if (v != 0 && v < SAC2_PAIRS)
+	  sac2_len = (uint32_t)v;
+	else if (v > SAC2_PAIRS)
+	  fprintf(stderr, "warning: there are %u pairs. using all\n", SAC2_PAIRS);
+      }
+      break;
+
     case 5: case 6: case 7:
       sample_type = (uint32_t)(c-5);
 
@@ -262,9 +492,32 @@ int main(int argc, char** argv)
     
     if (fill_type == sac) {
       switch(sample_type) {
-      case lds: create_file(filename, sac_buffer_fill_lds); return 0;
-      case lcg: create_file(filename, sac_buffer_fill_lcg); return 0;
-      case pcg: create_file(filename, sac_buffer_fill_pcg); return 0;
+      case lds: create_file(filename, sac_buffer_fill_lds, buffer, BUFFER_SIZE); return 0;
+      case lcg: create_file(filename, sac_buffer_fill_lcg, buffer, BUFFER_SIZE); return 0;
+      case pcg: create_file(filename, sac_buffer_fill_pcg, buffer, BUFFER_SIZE); return 0;
+      default:
+	internal_error("what sampling?", sample_type);
+	break;
+      }
+    }
+    else if (fill_type == sac2 || fill_type == delta) {
+      if (fill_type == sac2)
+	sac2_masks(sac2_len);
+      else {
+	static delta_t d[DELTA_MAX];
+	uint32_t n = parse_delta_list(delta_list, sample_state.inc, d, DELTA_MAX);
+
+	if (n == 0) return -1;
+
+	delta_masks(d, n);
+      }
+
+      size_t size = (size_t)row_samples*row_len*sizeof(uint64_t);
+
+      switch(sample_type) {
+      case lds: create_file(filename, row_buffer_fill_lds, row_buffer, size); return 0;
+      case lcg: create_file(filename, row_buffer_fill_lcg, row_buffer, size); return 0;
+      case pcg: create_file(filename, row_buffer_fill_pcg, row_buffer, size); return 0;
       default:
 	internal_error("what sampling?", sample_type);
 	break;
@@ -272,7 +525,7 @@ int main(int argc, char** argv)
     }
     else {
       switch(sample_type) {
-      case lds: create_file(filename, seq_buffer_fill_lds); return 0;
+      case lds: create_file(filename, seq_buffer_fill_lds, buffer, BUFFER_SIZE); return 0;
       case lcg: print_error("random sampling (lcg) "); return -1;
       case pcg: print_error("random sampline (pcg) "); return -1;
       default:
@@ -27,6 +27,11 @@
 #include <fcntl.h>
 #include <time.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <stdnoreturn.h>
 
 #include "util.h"
 #include "unif01.h"
@@ -103,89 +108,366 @@ static inline uint64_t prng_u64(UNUSED uint64_t x)
 }
 
 
-#include <x86intrin.h>
-static inline uint64_t crc32c_64(uint64_t x, uint32_t k) { return _mm_crc32_u64(k,x); }
-
-static inline uint64_t crc32_nl_goof_1(uint64_t x)
-{
-   x  = crc32c_64(x,0) ^ (x ^ (x >> 9));
-   x ^= (x*x) & UINT32_C(~1);
-   x ^= x >> 31;
-   x *= 0xc6a4a7935bd1e995;
-   x  = crc32c_64(x,0) ^ (x ^ (x >> 9));
-  return x;
-}
-
-
-// known to be weak: murmurhash64a finalizer
-static inline uint64_t murmur2(uint64_t x)
-{
-  x ^= x >> 47;
-  x *= 0xc6a4a7935bd1e995;
-  x ^= x >> 47;
-  return x;
-}
-
 
 //*****************************************************************************
 // common junk between the two programs
 
 #include "mini_testu01.h"
+#include "bitops.h"
 
 
 //*****************************************************************************
 
 // glue around hash function
 
+// generator output is produced in blocks: the counter sequence is
+// written to the buffer and then hashed in place by the batch version
+// of the active finalizer (or the 32-bit finalizer).
+#define GEN_BUFFER_LEN 1024
+
 // structure for current state and increment
 typedef struct {
-  uint64_t counter;
+  uint64_t counter;                   // next input to be hashed
   uint64_t inc;
+  uint32_t pos;                       // next unconsumed buffer entry
+  uint64_t buffer[GEN_BUFFER_LEN];
 } data_t;
 
-data_t data = {0};
+data_t data = {.pos = GEN_BUFFER_LEN};
+
+static void refill_64(void)
+{
+  uint64_t* b = data.buffer;
+  uint64_t  c = data.counter;
+  uint64_t  d = data.inc;
+
+  for(uint32_t i=0; i<GEN_BUFFER_LEN; i++) { b[i] = c; c += d; }
+
+  bit_finalizer_batch(b, b, GEN_BUFFER_LEN);
+
+  data.counter = c;
+  data.pos     = 0;
+}
+
+// 32-bit finalizers: the input is the counter reduced mod 2^32 so an odd
+// increment walks the full permutation and even ones a strided subset.
+static void refill_32(void)
+{
+  uint64_t* b = data.buffer;
+  uint64_t  c = data.counter;
+  uint64_t  d = data.inc;
+
+  for(uint32_t i=0; i<GEN_BUFFER_LEN; i++) { b[i] = c; c += d; }
+
+  bit_finalizer_32_batch(b, b, GEN_BUFFER_LEN);
+
+  data.counter = c;
+  data.pos     = 0;
+}
+
+// state based generator from a plugin. seeded with the counter at the
+// first refill, which only advances for bookkeeping afterward.
+void* prng_plugin_state   = NULL;
+bool  prng_plugin_enabled = false;
+
+static void refill_prng(void)
+{
+  if (!prng_plugin_state) {
+    size_t n = (plugin->state_size + 63) & ~(size_t)63;
+
+    prng_plugin_state = aligned_alloc(64, n ? n : 64);
+
+    if (!prng_plugin_state) {
+      fprintf(stderr, "error: plugin state allocation failed\n");
+      exit(-1);
+    }
+
+    memset(prng_plugin_state, 0, n ? n : 64);
+    plugin->seed(prng_plugin_state, data.counter);
+  }
+
+  plugin->next(prng_plugin_state, data.buffer, GEN_BUFFER_LEN);
+
+  data.counter += GEN_BUFFER_LEN*data.inc;
+  data.pos      = 0;
+}
+
+// differential source (--delta): hash(x) ^ hash((x + add) ^ mask) of the
+// counter sequence. both halves are batches.
+delta_t* delta_source = NULL;
+
+static void refill_diff(void)
+{
+  static uint64_t y[GEN_BUFFER_LEN];
+
+  uint64_t* b = data.buffer;
+  uint64_t  c = data.counter;
+  uint64_t  d = data.inc;
+  uint64_t  a = delta_source->add;
+  uint64_t  m = delta_source->mask;
+
+  for(uint32_t i=0; i<GEN_BUFFER_LEN; i++) { b[i] = c; y[i] = (c + a) ^ m; c += d; }
+
+  bit_finalizer_batch(b, b, GEN_BUFFER_LEN);
+  bit_finalizer_batch(y, y, GEN_BUFFER_LEN);
+
+  for(uint32_t i=0; i<GEN_BUFFER_LEN; i++) b[i] ^= y[i];
+
+  data.counter = c;
+  data.pos     = 0;
+}
+
+void (*refill)(void) = refill_64;
+
+// reversed views: the whole buffer is bit reversed after the refill
+void (*refill_rev_base)(void);
+
+static void refill_rev(void)
+{
+  refill_rev_base();
+  bit_reverse_array_64(data.buffer, data.buffer, GEN_BUFFER_LEN);
+}
 
 static inline uint64_t next(void)
 {
-  uint64_t r = bit_finalizer(data.counter);
+  if (data.pos >= GEN_BUFFER_LEN) refill();
 
-  data.counter += data.inc;
+  return data.buffer[data.pos++];
+}
 
-  return r;
+// input of the next unconsumed output
+static uint64_t next_counter(void)
+{
+  return data.counter - (GEN_BUFFER_LEN-data.pos)*data.inc;
 }
 
-// TestU01 is very dated and was designed to test 32-bit PRNGs.
-#if defined(__clang__)
-static inline uint64_t bit_reverse_64(uint64_t x) { return __builtin_bitreverse64(x); }
-#else
+//*****************************************************************************
+// hardware counters (--perf): totals for all battery calls, for the
+// generator refill (so the finalizer) and per test. Per test attribution
+// relies on TestU01 storing each p-value into 'bbattery_pVal' as the
+// test completes: the p-values are preset to -1 before each trial and
+// the refill checks if the next has been filled in. So attribution is at
+// refill granularity, the tail of a test's computation is charged to the
+// next test and a test's cost is charged to its first statistic.
+
+#define PERF_MAX_STAT 201
+
+bool          perf_enabled = false;
+perf_counts_t perf_battery;                 // all battery calls
+perf_counts_t perf_refill;                  // inside the generator refill
+perf_counts_t perf_stat[PERF_MAX_STAT];     // per test
+perf_counts_t perf_trial;                   // counters at start of trial
+perf_counts_t perf_mark;                    // counters at last attribution
+uint32_t      perf_cursor;                  // first statistic not complete
+
+void (*refill_base)(void);
+
+static void perf_attribute(const perf_counts_t* now)
+{
+  uint32_t i = perf_cursor;
 
-#if !defined(_MSC_VER)
-static inline uint64_t byteswap_64(uint64_t x) { return __builtin_bswap64(x); }
-#else
-// unary minus applied to unsigned type, result is still unsigned
-#pragma warning(disable:4146)
-static inline uint64_t byteswap_64(uint64_t x) { return _byteswap_uint64(x);  }
-#endif
+  if (i >= PERF_MAX_STAT || bbattery_pVal[i] < 0.0) return;
 
-static const uint64_t bit_set_even_1_64  = UINT64_C(0x5555555555555555);
-static const uint64_t bit_set_even_2_64  = UINT64_C(0x3333333333333333);
-static const uint64_t bit_set_even_4_64  = UINT64_C(0x0f0f0f0f0f0f0f0f);
+  perf_counts_accum(perf_stat+i, now, &perf_mark);
+  perf_mark = *now;
 
-#define  BIT_GROUP_SWAP(X,L,T) BIT_PERMUTE(X,bit_set_even_ ## L ## _ ## T,L)
+  while (i < PERF_MAX_STAT && bbattery_pVal[i] >= 0.0) i++;
 
-static inline uint32_t bit_swap_1_32 (uint32_t x) { return BIT_GROUP_SWAP(x, 1,32); }
-static inline uint32_t bit_swap_2_32 (uint32_t x) { return BIT_GROUP_SWAP(x, 2,32); }
-static inline uint32_t bit_swap_4_32 (uint32_t x) { return BIT_GROUP_SWAP(x, 4,32); }
+  perf_cursor = i;
+}
 
-static inline uint64_t bit_reverse_64(uint64_t x)
+static void refill_perf(void)
 {
-  x = byteswap_64(x);
-  x = bit_swap_4_64(x);
-  x = bit_swap_2_64(x);
-  x = bit_swap_1_64(x);
-  return x;
+  perf_counts_t s,e;
+
+  perf_counters_read(&s);
+  perf_attribute(&s);
+  refill_base();
+  perf_counters_read(&e);
+  perf_counts_accum(&perf_refill, &e, &s);
 }
-#endif
+
+// mark all p-values as not yet computed (see above)
+static void pvalue_reset(void)
+{
+  for(uint32_t i=0; i<PERF_MAX_STAT; i++) bbattery_pVal[i] = -1.0;
+}
+
+static void perf_trial_begin(void)
+{
+  pvalue_reset();
+
+  perf_cursor = 0;
+  perf_counters_read(&perf_trial);
+  perf_mark = perf_trial;
+}
+
+static void perf_trial_end(void)
+{
+  perf_counts_t now;
+
+  perf_counters_read(&now);
+  perf_counts_accum(&perf_battery, &now, &perf_trial);
+
+  // remainder belongs to the last test
+  if (perf_cursor < PERF_MAX_STAT)
+    perf_counts_accum(perf_stat+perf_cursor, &now, &perf_mark);
+}
+
+//*****************************************************************************
+// sample demand (--demand): counts the GetBits/GetU01 calls made by each
+// test for the current battery and size. Same p-value watching as above
+// but checked per call so the attribution is exact. Some tests have a
+// data dependent number of draws (for example: gap tests) so the counts
+// are for this run's data.
+
+char*       demand_filename = NULL;
+bool        demand_enabled  = false;
+uint64_t    demand_bits[PERF_MAX_STAT];
+uint64_t    demand_u01[PERF_MAX_STAT];
+uint32_t    demand_cursor;
+unif01_Gen* demand_gen;                 // the generator being counted
+
+static inline uint32_t demand_test(void)
+{
+  uint32_t i = demand_cursor;
+
+  while (i < PERF_MAX_STAT-1 && bbattery_pVal[i] >= 0.0) i++;
+
+  return demand_cursor = i;
+}
+
+static uint64_t demand_next_u32(void* p, void* s)
+{
+  demand_bits[demand_test()]++;
+  return demand_gen->GetBits(p,s);
+}
+
+static double demand_next_f64(void* p, void* s)
+{
+  demand_u01[demand_test()]++;
+  return demand_gen->GetU01(p,s);
+}
+
+//*****************************************************************************
+// progress (--progress): samples are counted (relaxed atomic add) and the
+// time spent in the generator refill accumulated once per refill, so at
+// buffer granularity and nothing is added to next(). A timer thread
+// reports rate, the finalizer share of wall time and an ETA to stderr
+// which (unlike stdout) isn't redirected around the battery calls. The
+// per trial demand comes from a --demand table (--expect), is exact for
+// alphabit/block and is otherwise measured by the first trial.
+
+bool     progress_enabled = false;
+uint32_t progress_period  = 5;          // seconds between reports
+char*    progress_expect  = NULL;       // --demand table
+uint64_t progress_samples = 0;          // atomic: generated samples
+uint64_t progress_hash_ns = 0;          // atomic: time inside refill
+uint64_t progress_demand  = 0;          // samples per trial (0=unknown)
+uint32_t progress_trial   = 0;          // atomic: trial being run
+uint32_t progress_trials  = 0;          // atomic: number of trials
+bool     progress_measure = false;      // take demand from first trial
+bool     progress_done    = false;      // atomic: stop the thread
+bool     progress_tty     = false;
+uint64_t progress_start;
+
+pthread_t       progress_tid;
+pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void (*refill_progress_base)(void);
+
+static void refill_progress(void)
+{
+  uint64_t t0 = get_timestamp();
+  refill_progress_base();
+  uint64_t t1 = get_timestamp();
+
+  __atomic_fetch_add(&progress_samples, GEN_BUFFER_LEN, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&progress_hash_ns, t1-t0,          __ATOMIC_RELAXED);
+}
+
+static void progress_print(void)
+{
+  extern uint32_t trial_first;
+
+  uint64_t n = __atomic_load_n(&progress_samples, __ATOMIC_RELAXED);
+  uint64_t h = __atomic_load_n(&progress_hash_ns, __ATOMIC_RELAXED);
+  uint64_t d = __atomic_load_n(&progress_demand,  __ATOMIC_RELAXED);
+  uint32_t t = __atomic_load_n(&progress_trial,   __ATOMIC_RELAXED);
+  uint32_t m = __atomic_load_n(&progress_trials,  __ATOMIC_RELAXED);
+  uint64_t e = get_timestamp() - progress_start;
+  double   r = (e != 0) ? 1e9*(double)n/(double)e : 0.0;
+
+  pthread_mutex_lock(&progress_lock);
+
+  fprintf(stderr, "%strial %u/%u  %8.3f M samples/s  hash %5.1f%%",
+	  progress_tty ? "\r" : "",
+	  (t < m) ? t+1 : m, m,
+	  1e-6*r, (e != 0) ? 100.0*(double)h/(double)e : 0.0);
+
+  if (d != 0 && r > 0.0) {
+    double total = (double)d*(double)(m-trial_first);
+    double left  = fmax(total-(double)n, 0.0);
+    uint64_t s   = (uint64_t)(left/r);
+
+    fprintf(stderr, "  %5.1f%%  ETA %02lu:%02lu:%02lu",
+	    fmin(100.0*(double)n/total, 100.0), s/3600, (s/60)%60, s%60);
+  }
+  else
+    fprintf(stderr, "  ETA ?");
+
+  fprintf(stderr, progress_tty ? "\033[K" : "\n");
+
+  pthread_mutex_unlock(&progress_lock);
+}
+
+// clear the status line before writing to stdout
+static void progress_clear(void)
+{
+  if (!progress_tty) return;
+
+  pthread_mutex_lock(&progress_lock);
+  fprintf(stderr, "\r\033[K");
+  pthread_mutex_unlock(&progress_lock);
+}
+
+static void* progress_thread(void* UNUSED arg)
+{
+  // sleep in short steps so the end of the run isn't delayed
+  const struct timespec step = {.tv_sec = 0, .tv_nsec = 100000000};
+
+  while (1) {
+    for(uint32_t i=0; i<10*progress_period; i++) {
+      if (__atomic_load_n(&progress_done, __ATOMIC_ACQUIRE)) return NULL;
+      nanosleep(&step, NULL);
+    }
+    progress_print();
+  }
+}
+
+static bool progress_begin(void)
+{
+  progress_tty   = isatty(STDERR_FILENO);
+  progress_start = get_timestamp();
+
+  refill_progress_base = refill;
+  refill               = refill_progress;
+
+  if (pthread_create(&progress_tid, NULL, progress_thread, NULL) == 0)
+    return true;
+
+  refill = refill_progress_base;
+
+  return false;
+}
+
+static void progress_end(void)
+{
+  __atomic_store_n(&progress_done, true, __ATOMIC_RELEASE);
+  pthread_join(progress_tid, NULL);
+  progress_clear();
+}
+
 
 
 
@@ -219,20 +501,39 @@ static double next_hi_f64(void* UNUSED p, void* UNUSED s)
   return (double)i*0x1.0p-53;
 }
 
+// TestU01 is very dated and was designed to test 32-bit PRNGs. The
+// reversed views read a buffer that's bit reversed as a block at refill
+// (see refill_rev).
 static uint64_t next_rev_u32(void* UNUSED p, void* UNUSED s)
 {
-  return bit_reverse_64(next()) & 0xffffffff;
+  return next() & 0xffffffff;
 }
 
 static double next_rev_f64(void* UNUSED p, void* UNUSED s)
 {
-  uint64_t i = bit_reverse_64(next());
+  uint64_t i = next();
 
   i &= 0x1fffffffffffff;
   
   return (double)i*0x1.0p-53;
 }
 
+// 32-bit finalizers: outputs are in the low 32-bits
+static double next_32_f64(void* UNUSED p, void* UNUSED s)
+{
+  return (double)next()*0x1.0p-32;
+}
+
+static uint64_t next_rev_32_u32(void* UNUSED p, void* UNUSED s)
+{
+  return next() >> 32;
+}
+
+static double next_rev_32_f64(void* UNUSED p, void* UNUSED s)
+{
+  return (double)(next() >> 32)*0x1.0p-32;
+}
+
 
 //*****************************************************************************
 // all ugly temp hacks
@@ -508,13 +809,28 @@ uint32_t sample  = sample_lo;
 uint32_t trials  = 20;
 double   battery_bits = 32.0*1000.0;
 char*    filename = NULL;
+bool     full_period  = false;
+bool     battery_bits_set = false;   // explicit size given
 
 uint32_t trial_num = 0;
+uint64_t counter_initial;             // counter at trial zero
 uint32_t statistic_count  = 0;
 uint32_t note_count       = 0;
 uint32_t suspicious_count = 0;
 uint32_t failure_count    = 0;
 bool     first_reported   = false;
+double   worst_t          = 1.0;      // over all statistics & trials
+double   score_sum        = 0.0;      // sum of -ln(2t): each Exp(1) if uniform
+uint64_t score_n          = 0;
+char*    compare_list     = NULL;     // --hash=all or comma separated
+uint32_t compare_jobs     = 0;        // zero is # of processors
+bool     tournament_enabled = false;
+bool     stages_enabled     = false;
+uint32_t stages_samples     = 1u << 16; // avalanche inputs
+bool     diff_enabled       = false;
+uint32_t diff_samples       = 1u << 20; // differential statistics inputs
+char*    delta_list         = NULL;     // --delta
+char*    tournament_file    = NULL;   // xorshift_mul_3 parameter sets
 
 bool     pvalue_trim    = true;
 double   pvalue_report  = 0.01;
@@ -581,6 +897,10 @@ void report(void)
     double t      = fmin(pvalue,1.0-pvalue);
     bool   show   = true;
 
+    worst_t    = fmin(worst_t, t);
+    score_sum -= log(fmax(2.0*t, DBL_MIN));
+    score_n   += 1;
+
     if (t >= pvalue_report) continue;
 
     // track worst p-value
@@ -611,6 +931,19 @@ void report(void)
   }
 }
 
+// SI scaled count in 'w' characters
+void print_count(uint32_t w, bool valid, double v)
+{
+  static const char suffix[] = " KMGTP";
+  uint32_t i = 0;
+
+  if (!valid) { printf("%*s", w, "-"); return; }
+
+  while (v >= 999.95 && i < 5) { v *= 0.001; i++; }
+
+  printf("%*.1f%c", w-1, v, suffix[i]);
+}
+
 // cumulative report (WIP)
 void report_final(void)
 {
@@ -620,14 +953,18 @@ void report_final(void)
   printf("\n" BOLD "TOTALS:" ENDC "\n");
   
   // modify the existing table def since we're done
-  mini_report_table_init(&table, 5, "   ","statistic","suspicious","   fail   ", "  worst t   ");
+  if (!perf_enabled)
+    mini_report_table_init(&table, 5, "   ","statistic","suspicious","   fail   ", "  worst t   ");
+  else
+    mini_report_table_init(&table, 9, "   ","statistic","suspicious","   fail   ", "  worst t   ",
+			   "  cycles  ","  instrs  "," br-miss  "," $-miss   ");
   mini_report_set_col_width(&table, 1, 31, mini_report_justify_center);
   mini_report_table_header(stdout, &table);
   
   for(uint32_t i=0; i<e; i++) {
 
-    // skip statistic with no questionable/fails
-    if ((total_warn[i] + total_error[i]) == 0) continue;
+    // skip statistic with no questionable/fails (all shown w/ counters)
+    if (!perf_enabled && (total_warn[i] + total_error[i]) == 0) continue;
 
     printf("%s"             // divider
 	   "%*u"            // # of the statistic
@@ -639,8 +976,7 @@ void report_final(void)
 	   "%*u"            // fail count
 	   "%s"             // divider
 	   "%e"
-	   "%s"             // divider
-	   "\n",
+	   "%s",            // divider
 	   
 	   div, table.col[0].width,   i,
 	   div, table.col[1].width-1, bbattery_TestNames[i],
@@ -649,6 +985,16 @@ void report_final(void)
 	   div, total_peak[i],
 	   div
 	   );
+
+    // per trial average of the counters
+    if (perf_enabled) {
+      for(uint32_t c=0; c<perf_counter_length; c++) {
+	print_count(table.col[5+c].width, perf_counter_valid[c], (double)perf_stat[i].v[c]/trials);
+	printf("%s", div);
+      }
+    }
+
+    printf("\n");
   }
 
   mini_report_table_end(stdout, &table);
@@ -656,116 +1002,857 @@ void report_final(void)
 
 
 
+// per trial counters for the battery and the generator refill
+void report_perf(void)
+{
+  double k = 1.0/trials;
+
+  printf("\n" BOLD "COUNTERS:" ENDC " (per trial)\n");
+  printf("           ");
+  for(uint32_t c=0; c<perf_counter_length; c++) printf(" %13s", perf_counter_name[c]);
+  printf("\n  battery: ");
+  for(uint32_t c=0; c<perf_counter_length; c++) {
+    printf("    ");
+    print_count(10, perf_counter_valid[c], k*(double)perf_battery.v[c]);
+  }
+  printf("\n  refill:  ");
+  for(uint32_t c=0; c<perf_counter_length; c++) {
+    printf("    ");
+    print_count(10, perf_counter_valid[c], k*(double)perf_refill.v[c]);
+  }
+  printf("\n");
+
+  if (perf_counter_valid[perf_cycles] && perf_battery.v[perf_cycles] != 0) {
+    double f = (double)perf_refill.v[perf_cycles]/(double)perf_battery.v[perf_cycles];
+    printf("  refill share of cycles: %.1f%%\n", 100.0*f);
+  }
+
+  if (perf_counter_valid[perf_cycles] && perf_counter_valid[perf_instructions] && perf_battery.v[perf_cycles] != 0)
+    printf("  IPC: %.2f\n", (double)perf_battery.v[perf_instructions]/(double)perf_battery.v[perf_cycles]);
+}
+
+// per test generator calls. a binary file source consumes 32-bits
+// per call (either type) so that's the required file size.
+void report_demand(void)
+{
+  uint32_t e     = (uint32_t)bbattery_NTests;
+  uint64_t words = 0;
+  FILE*    file  = NULL;
+
+  if (demand_filename) {
+    file = fopen(demand_filename, "w");
+    if (!file) fprintf(stderr, "error: couldn't open '%s'\n", demand_filename);
+  }
+
+  printf("\n" BOLD "DEMAND:" ENDC " %s, battery_bits = %.0f\n", battery_info[battery].name, battery_bits);
+  printf("  test       GetBits        GetU01  statistic\n");
+
+  if (file) {
+    fprintf(file, "# mini_testu01 sample demand: %s, battery_bits = %.0f\n", battery_info[battery].name, battery_bits);
+    fprintf(file, "# test       GetBits        GetU01  statistic\n");
+  }
+
+  for(uint32_t i=0; i<=e && i<PERF_MAX_STAT; i++) {
+    uint64_t b = demand_bits[i];
+    uint64_t u = demand_u01[i];
+
+    if ((b|u) == 0) continue;
+
+    char* name = (i < e) ? bbattery_TestNames[i] : "(after last statistic)";
+
+    printf("  %4u %13lu %13lu  %s\n", i, b, u, name);
+    if (file) fprintf(file, "  %4u %13lu %13lu  %s\n", i, b, u, name);
+
+    words += b+u;
+  }
+
+  printf("  total: %lu 32-bit words = %lu bytes\n", words, 4*words);
+
+  if (file) {
+    fprintf(file, "battery %s\nbits %.0f\nwords %lu\nbytes %lu\n", battery_info[battery].name, battery_bits, words, 4*words);
+    fclose(file);
+  }
+}
+
 //*****************************************************************************
 // TestU01 interface. just globals.
 
 unif01_Gen* gen;
 
-bool testu01out = false;
+//*****************************************************************************
+// second level tests (--second): the p-values of each statistic across
+// trials should be U(0,1). Kolmogorov-Smirnov and Anderson-Darling tests
+// of them are updated after each trial so a bias that never reaches the
+// per trial thresholds is detected after a modest number of trials. Each
+// statistic keeps a fixed size reservoir sample (exact until it fills)
+// so memory is bounded for any number of trials. With --stop the run ends
+// at the first trial with a failure (either level).
 
-static void print_state(void* UNUSED s)
+#define SECOND_LEN 1024
+#define SECOND_MIN 8                    // trials before testing
+
+typedef struct {
+  uint32_t n;                           // p-values seen
+  uint32_t first;                       // trial first below 'pvalue_suspect'
+  bool     flagged;
+  double   ks_d, ks_p;
+  double   ad_a, ad_p;
+  double   v[SECOND_LEN];
+} second_sketch_t;
+
+bool             second_enabled = false;
+bool             second_stop    = false;    // end run on a failure
+second_sketch_t* second_sketch  = NULL;     // [PERF_MAX_STAT]
+uint64_t         second_prng    = 1;
+
+// Marsaglia & Marsaglia, "Evaluating the Anderson-Darling Distribution", 2004
+// upper tail of the asymptotic distribution (directly to keep small values)
+static double ad_inf_upper(double z)
 {
-  printf("  counter = 0x%016lx\n", data.counter);
+  if (z < 2.0)
+    return 1.0-exp(-1.2337141/z)/sqrt(z)*(2.00012+(.247105-(.0649821-(.0347962-(.011672-.00168691*z)*z)*z)*z)*z);
+
+  return -expm1(-exp(1.0776-(2.30695-(.43424-(.082433-(.008056-.0003146*z)*z)*z)*z)*z));
 }
 
-unif01_Gen gen_lo = {
-  .name    = "low bits",
-  .GetU01  = &next_lo_f64,
-  .GetBits = &next_lo_u32,
-  .Write   = &print_state
-};
+static double ad_errfix(double n, double x)
+{
+  double c,t;
 
-unif01_Gen gen_hi = {
-  .name    = "hi bits",
-  .GetU01  = &next_lo_f64,
-  .GetBits = &next_lo_u32,
-  .Write   = &print_state
-};
+  if (x > 0.8)
+    return (-130.2137+(745.2337-(1705.091-(1950.646-(1116.360-255.7844*x)*x)*x)*x)*x)/n;
 
-unif01_Gen gen_rev = {
-  .name    = "bitreversed",
-  .GetU01  = &next_rev_f64,
-  .GetBits = &next_rev_u32,
-  .Write   = &print_state
-};
+  c = .01265+.1757/n;
 
-unif01_Gen* gen = &gen_lo;
+  if (x < c) {
+    t = x/c;
+    t = sqrt(t)*(1.0-t)*(49.0*t-102.0);
+    return t*(.0037/(n*n)+.00078/n+.00006)/n;
+  }
 
-void help_options(char* name)
+  t = (x-c)/(.8-c);
+  t = -.00022633+(6.54034-(14.6538-(14.458-(8.259-1.91864*t)*t)*t)*t)*t;
+
+  return t*(.04213/n+.01365/(n*n));
+}
+
+// upper tail probability of A^2 = z for sample size n. the finite n
+// correction doesn't go to zero at the far tail (-0.0006/n at x=1) so
+// isn't applied there (where the asymptotic is accurate).
+static double ad_pvalue(uint32_t n, double z)
 {
-  printf("Usage: %s [OPTIONS] [FILE]\n", name);
-  printf("\n"
-	 "\n Batteries:\n" 
-	 "  --alphabit[=BLOCKS]  (default)\n"
-	 "  --block[=BLOCKS]     block alphabit\n"
-	 "  --rabbit[=BLOCKS]    \n"
-	 "  --smallcrush         smallcrush file input requires textfile of\n"
-	 "                       doubles on [0,1). I've never tried it.\n"
-	 "  --crush              crush can't be run on a file\n"
-	 "\n p-value limits:     thresholds to display statistic results\n"
-	 "  --pshow=[VALUE]      display              (disabled by default)\n" 
-	 "  --psus=[VALUE]       report as suspicious (default = 0.001)\n" 
-	 "  --pfail=[VALUE]      report as fail       (default = 2^(-40))\n" 
-	 "\n TestU01 Output:     any of these disable this program's output\n" 
-	 "                       and uses TestU01's internal reporting instead\n" 
-	 "  --short                summaries per trial only\n"
-	 "  --verbose            \n"
-	 "  --collectors         \n"
-	 "  --classes            \n"
-	 "  --counters           \n"
-	 "\n Sampling            only used for non-file runs\n"
-	 "  --hi                 upper 32 bits fed to tests\n"
-	 "  --lo                 lower 32 bits fed to tests\n"
-	 "  --reversed           bit-reversed output fed to tests\n"
-	 "  --fundamental        Weyl sequence constant is one (default)\n"
-	 "  --increment=VALUE    Weyl sequence constant (odd integer)\n"
-	 "  --phi                Weyl sequence constant is golden ratio\n"
-	 "  --counter=VALUE      Weyl sequence inital value (default is random)\n"
-	 "");
+  double q = ad_inf_upper(z);
 
-  exit(0);
+  if (q > 0.001)
+    q -= ad_errfix((double)n, 1.0-q);
+
+  return fmin(fmax(q, 0.0), 1.0);
 }
 
+// upper tail probability of D (asymptotic with Stephens' correction)
+static double ks_pvalue(uint32_t n, double d)
+{
+  double r = sqrt((double)n);
+  double l = (r+0.12+0.11/r)*d;
+  double s = 0.0, sign = 1.0;
 
-void battery_set(uint32_t id)
+  if (l < 0.2) return 1.0;
+
+  for(uint32_t k=1; k<=100; k++) {
+    double t = exp(-2.0*k*k*l*l);
+    s   += sign*t;
+    sign = -sign;
+    if (t < 1e-18) break;
+  }
+
+  return fmin(fmax(2.0*s, 0.0), 1.0);
+}
+
+static int second_cmp(const void* a, const void* b)
 {
-  battery = id;
+  double x = *(const double*)a;
+  double y = *(const double*)b;
 
-  if (optarg) {
-    // alphabit & rabbit takes an optional argument
-    char*    end;
-    uint64_t val = strtoul(optarg, &end, 0);
+  return (x > y) - (x < y);
+}
 
-    if (end[0] == 0) {
-      double bits = (double)val * 64.0;
+static void second_compute(second_sketch_t* s)
+{
+  uint32_t n = (s->n < SECOND_LEN) ? s->n : SECOND_LEN;
+  double   u[SECOND_LEN];
+  double   d = 0.0, a = 0.0;
 
-      if (bits >= 512.0)
-	battery_bits = bits;
-      else {
-	printf("blocks=%s ignored. >= 8 required\n", optarg);
-      }
-    }
-    else printf("warning: skipping block argument %s\n", optarg);
+  memcpy(u, s->v, n*sizeof(double));
+  qsort(u, n, sizeof(double), second_cmp);
+
+  for(uint32_t i=0; i<n; i++) {
+    double x = fmin(fmax(u[i],     DBL_MIN), 1.0-DBL_EPSILON);
+    double y = fmin(fmax(u[n-1-i], DBL_MIN), 1.0-DBL_EPSILON);
+
+    d  = fmax(d, fmax((double)(i+1)/n - u[i], u[i] - (double)i/n));
+    a += (2.0*i+1.0)*(log(x)+log1p(-y));
   }
+
+  s->ks_d = d;
+  s->ks_p = ks_pvalue(n, d);
+  s->ad_a = -(double)n - a/n;
+  s->ad_p = ad_pvalue(n, s->ad_a);
 }
 
-void parse_options(int argc, char **argv)
+static void second_add(const double* p, uint32_t count)
 {
-  static struct option long_options[] = {
-    {"alphabit",   optional_argument, 0, 'a'},
-    {"block",      optional_argument, 0, 'b'},
-    {"rabbit",     optional_argument, 0, 'r'},
-    {"smallcrush", no_argument,       0, 's'},
+  if (count > PERF_MAX_STAT) count = PERF_MAX_STAT;
+
+  for(uint32_t i=0; i<count; i++) {
+    second_sketch_t* s = second_sketch+i;
+    uint32_t         j = s->n++;
+
+    // reservoir sampling once full
+    if (j >= SECOND_LEN) {
+      second_prng = prng_mul_k*second_prng + prng_add_k;
+      j = (uint32_t)(((second_prng >> 32)*(uint64_t)s->n) >> 32);
+      if (j >= SECOND_LEN) continue;
+    }
+
+    s->v[j] = p[i];
+  }
+}
+
+static bool second_init(void)
+{
+  second_sketch = calloc(PERF_MAX_STAT, sizeof(second_sketch_t));
+  second_prng   = counter_initial;
+
+  return second_sketch != NULL;
+}
+
+// adds the 'e' p-values of 'trial': returns true if a statistic fails
+static bool second_trial(const double* pval, uint32_t e, uint32_t trial)
+{
+  bool fail = false;
+
+  second_add(pval, e);
+
+  for(uint32_t i=0; i<e && i<PERF_MAX_STAT; i++) {
+    second_sketch_t* s = second_sketch+i;
+
+    if (s->n < SECOND_MIN) continue;
+
+    second_compute(s);
+
+    double p = fmin(s->ks_p, s->ad_p);
+
+    fail |= (p <= pvalue_fail);
+
+    if (s->flagged || p > pvalue_suspect) continue;
+
+    s->flagged = true;
+    s->first   = trial;
+  }
+
+  return fail;
+}
+
+// after each trial: returns true if a statistic fails
+bool second_update(void)
+{
+  return second_trial(bbattery_pVal, (uint32_t)bbattery_NTests, trial_num);
+}
+
+void report_second(void)
+{
+  uint32_t e    = (uint32_t)bbattery_NTests;
+  char*    div  = table.style->div;
+  bool     some = false;
+  double   low  = 1.0;
+
+  if (e > PERF_MAX_STAT) e = PERF_MAX_STAT;
+
+  for(uint32_t i=0; i<e; i++) {
+    second_sketch_t* s = second_sketch+i;
+
+    if (s->n < SECOND_MIN) continue;
+
+    second_compute(s);
+
+    double p = fmin(s->ks_p, s->ad_p);
+
+    low = fmin(low, p);
+
+    if (p >= pvalue_report) continue;
+
+    if (!some) {
+      printf("\n" BOLD "SECOND LEVEL:" ENDC " KS & AD of p-values across trials\n");
+      mini_report_table_init(&table, 8, "   ","statistic"," n  ","  KS D  ","   KS p   ","   A^2   ","   AD p   "," at ");
+      mini_report_set_col_width(&table, 1, 31, mini_report_justify_center);
+      mini_report_table_header(stdout, &table);
+      some = true;
+    }
+
+    printf("%s%*u%s %-*s%s%*u%s%*.4f%s",
+	   div, table.col[0].width,   i,
+	   div, table.col[1].width-1, bbattery_TestNames[i],
+	   div, table.col[2].width,   s->n,
+	   div, table.col[3].width,   s->ks_d,
+	   div);
+    print_pvalue(stdout, s->ks_p);
+    printf("%s%*.3f%s", div, table.col[5].width, s->ad_a, div);
+    print_pvalue(stdout, s->ad_p);
+
+    // trial it first became suspicious
+    if (s->flagged)
+      printf("%s%*u%s\n", div, table.col[7].width, s->first, div);
+    else
+      printf("%s%*s%s\n", div, table.col[7].width, "", div);
+  }
+
+  if (some)
+    mini_report_table_end(stdout, &table);
+  else if (low < 1.0)
+    printf("second level: no statistic below %g (min p = %f)\n", pvalue_report, low);
+}
+
+//*****************************************************************************
+// checkpoint (--checkpoint/--resume): after each trial the accumulated
+// state and all per trial p-values so far are written to a binary file
+// (to a temp then renamed so a kill mid-write leaves the previous one).
+// The stored counter is the input of the next unconsumed sample so a
+// resumed run sees the identical sequence. The test names follow the
+// p-values so cached results (below) can be reported without running
+// the battery. Doesn't cover --perf/--demand.
+
+#define CHECKPOINT_MAGIC   0x6b63746d   // "mtck"
+#define CHECKPOINT_VERSION 5
+
+// what must match to continue a run
+typedef struct {
+  char     hash[64];                    // finalizer name (readable prefix)
+  uint64_t hash_id;                     // FNV-1a of the full name
+  double   battery_bits;
+  uint64_t inc;
+  uint32_t battery;
+  uint32_t sample;
+  uint64_t delta_add;                   // --delta source (zero if not)
+  uint64_t delta_mask;
+} run_config_t;
+
+typedef struct {
+  uint32_t     magic;
+  uint32_t     version;
+  run_config_t config;
+  uint64_t     counter;                 // input of the next sample
+  uint64_t     counter_initial;
+  uint32_t     trial_num;               // completed trials
+  uint32_t     num_pvalues;             // per trial
+  uint32_t     statistic_count;
+  uint32_t     note_count;
+  uint32_t     suspicious_count;
+  uint32_t     failure_count;
+  uint16_t     total_warn[LENGTHOF(total_warn)];
+  uint16_t     total_error[LENGTHOF(total_error)];
+  double       total_peak[LENGTHOF(total_peak)];
+} checkpoint_t;                         // followed by p-values & names
+
+char*    checkpoint_filename = NULL;
+char*    resume_filename     = NULL;
+double*  checkpoint_pval     = NULL;    // [trial][num_pvalues]
+char*    checkpoint_names    = NULL;    // num_pvalues strings
+uint32_t checkpoint_npval    = 0;
+uint32_t checkpoint_trials   = 0;       // loaded trials
+uint32_t trial_first         = 0;       // first trial of this run
+
+static void run_config_get(run_config_t* c)
+{
+  memset(c, 0, sizeof(*c));
+  strncpy(c->hash, bit_finalizer_name, sizeof(c->hash)-1);
+  c->hash_id      = fnv_64(bit_finalizer_name, strlen(bit_finalizer_name), FNV_64_INIT);
+  c->battery_bits = battery_bits;
+  c->inc          = data.inc;
+  c->battery      = battery;
+  c->sample       = sample;
+
+  if (delta_source) {
+    c->delta_add  = delta_source->add;
+    c->delta_mask = delta_source->mask;
+  }
+}
+
+static void checkpoint_state(checkpoint_t* ck)
+{
+  memset(ck, 0, sizeof(*ck));
+  ck->magic            = CHECKPOINT_MAGIC;
+  ck->version          = CHECKPOINT_VERSION;
+  ck->counter          = next_counter();
+  ck->counter_initial  = counter_initial;
+  ck->trial_num        = trial_num+1;
+  ck->num_pvalues      = checkpoint_npval;
+  ck->statistic_count  = statistic_count;
+  ck->note_count       = note_count;
+  ck->suspicious_count = suspicious_count;
+  ck->failure_count    = failure_count;
+  run_config_get(&ck->config);
+  memcpy(ck->total_warn,  total_warn,  sizeof(total_warn));
+  memcpy(ck->total_error, total_error, sizeof(total_error));
+  memcpy(ck->total_peak,  total_peak,  sizeof(total_peak));
+}
+
+// called after trial 'trial_num' is reported
+void checkpoint_write(void)
+{
+  uint32_t n = (uint32_t)bbattery_NTests;
+  size_t   len;
+
+  // p-value count is fixed by the battery & size: keep the first
+  if (checkpoint_npval == 0) checkpoint_npval = n;
+
+  checkpoint_pval = realloc(checkpoint_pval, (trial_num+1)*checkpoint_npval*sizeof(double));
+
+  if (!checkpoint_pval) {
+    fprintf(stderr, FAIL "error:" ENDC " checkpoint allocation failed\n");
+    exit(-1);
+  }
+
+  for(uint32_t i=0; i<checkpoint_npval; i++)
+    checkpoint_pval[trial_num*checkpoint_npval+i] = (i < n) ? bbattery_pVal[i] : -1.0;
+
+  checkpoint_t ck;
+  checkpoint_state(&ck);
+
+  len = strlen(checkpoint_filename);
+
+  // per process temp: concurrent runs of the same --cache entry each
+  // rename a complete file into place
+  char  temp[len+24];
+  FILE* file;
+
+  snprintf(temp, sizeof(temp), "%s.%d.tmp", checkpoint_filename, (int)getpid());
+
+  file = fopen(temp, "wb");
+
+  if (file) {
+    bool ok = fwrite(&ck, sizeof(ck), 1, file) == 1;
+    ok &= fwrite(checkpoint_pval, sizeof(double)*checkpoint_npval, ck.trial_num, file) == ck.trial_num;
+
+    for(uint32_t i=0; i<checkpoint_npval; i++) {
+      char* name = (i < n && bbattery_TestNames[i]) ? bbattery_TestNames[i] : "";
+      ok &= fwrite(name, strlen(name)+1, 1, file) == 1;
+    }
+
+    ok &= fflush(file) == 0;
+    ok &= fsync(fileno(file)) == 0;
+    ok &= fclose(file) == 0;
+
+    if (ok && rename(temp, checkpoint_filename) == 0) return;
+
+    unlink(temp);
+  }
+
+  fprintf(stderr, WARNING "warning" ENDC ": couldn't write checkpoint '%s'\n", checkpoint_filename);
+}
+
+// loads 'name' (which must match the current configuration). the totals
+// are restored if 'totals' otherwise they're rebuilt by replaying.
+static void checkpoint_load(char* name, bool totals)
+{
+  FILE*        file = fopen(name, "rb");
+  checkpoint_t ck;
+  run_config_t c;
+
+  if (!file || fread(&ck, sizeof(ck), 1, file) != 1) {
+    fprintf(stderr, FAIL "error:" ENDC " couldn't read checkpoint '%s'\n", name);
+    exit(-1);
+  }
+
+  if (ck.magic != CHECKPOINT_MAGIC || ck.version != CHECKPOINT_VERSION) {
+    fprintf(stderr, FAIL "error:" ENDC " '%s' isn't a checkpoint (or old version)\n", name);
+    exit(-1);
+  }
+
+  run_config_get(&c);
+
+  char* mismatch = NULL;
+
+  if      (c.hash_id != ck.config.hash_id ||
+	   strcmp(c.hash, ck.config.hash) != 0)       mismatch = "hash";
+  else if (c.battery      != ck.config.battery)       mismatch = "battery";
+  else if (c.battery_bits != ck.config.battery_bits)  mismatch = "battery size";
+  else if (c.inc          != ck.config.inc)           mismatch = "increment";
+  else if (c.sample       != ck.config.sample)        mismatch = "sample";
+  else if (c.delta_add    != ck.config.delta_add ||
+	   c.delta_mask   != ck.config.delta_mask)    mismatch = "delta";
+
+  if (mismatch) {
+    fprintf(stderr, FAIL "error:" ENDC " %s doesn't match checkpoint '%s'\n", mismatch, name);
+    exit(-1);
+  }
+
+  size_t n = (size_t)ck.trial_num*ck.num_pvalues;
+
+  checkpoint_pval  = malloc((n ? n : 1)*sizeof(double));
+  checkpoint_names = malloc(64*(size_t)ck.num_pvalues+1);
+  checkpoint_npval = ck.num_pvalues;
+
+  if (!checkpoint_pval || !checkpoint_names || fread(checkpoint_pval, sizeof(double), n, file) != n) {
+    fprintf(stderr, FAIL "error:" ENDC " checkpoint '%s' truncated\n", name);
+    exit(-1);
+  }
+
+  // the names are short (TestU01 limits them)
+  size_t len = fread(checkpoint_names, 1, 64*(size_t)ck.num_pvalues, file);
+  checkpoint_names[len] = 0;
+
+  fclose(file);
+
+  data.counter      = ck.counter;
+  counter_initial   = ck.counter_initial;
+  second_prng       = counter_initial;  // reservoir sampling as a single run
+  data.pos          = GEN_BUFFER_LEN;
+  trial_num         = ck.trial_num;
+  trial_first       = ck.trial_num;
+  checkpoint_trials = ck.trial_num;
+
+  if (!totals) return;
+
+  statistic_count  = ck.statistic_count;
+  note_count       = ck.note_count;
+  suspicious_count = ck.suspicious_count;
+  failure_count    = ck.failure_count;
+  memcpy(total_warn,  ck.total_warn,  sizeof(total_warn));
+  memcpy(total_error, ck.total_error, sizeof(total_error));
+  memcpy(total_peak,  ck.total_peak,  sizeof(total_peak));
+}
+
+void checkpoint_resume(void)
+{
+  checkpoint_load(resume_filename, true);
+
+  if (second_enabled) {
+    for(uint32_t t=0; t<checkpoint_trials; t++)
+      second_trial(checkpoint_pval+t*checkpoint_npval, checkpoint_npval, t);
+  }
+
+  // keep checkpointing to the same file unless told otherwise
+  if (!checkpoint_filename) checkpoint_filename = resume_filename;
+}
+
+//*****************************************************************************
+// result cache (--cache): a checkpoint file named by a hash of the full
+// configuration (including the initial counter) in a cache directory. A
+// hit reports the stored trials as if run and only the missing trials
+// (if --trials was raised) are computed and added to the entry.
+
+char*    cache_dir     = NULL;
+bool     cache_enabled = false;
+bool     cache_hit     = false;
+
+static uint64_t cache_key(uint64_t counter)
+{
+  struct { run_config_t c; uint64_t counter; } k;
+
+  run_config_get(&k.c);
+  k.counter = counter;
+
+  // FNV-1a then a final mix
+  return prng_mix_64(fnv_64(&k, sizeof(k), FNV_64_INIT));
+}
+
+void cache_open(void)
+{
+  static char path[4096];
+
+  char* dir = cache_dir;
+
+  if (!dir) {
+    char* base = getenv("XDG_CACHE_HOME");
+
+    if (base)
+      snprintf(path, sizeof(path), "%s", base);
+    else
+      snprintf(path, sizeof(path), "%s/.cache", (base = getenv("HOME")) ? base : ".");
+
+    mkdir(path, 0755);
+    strncat(path, "/mini_testu01", sizeof(path)-strlen(path)-1);
+    dir = strdup(path);
+  }
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, WARNING "warning" ENDC ": --cache ignored. couldn't create '%s'\n", dir);
+    cache_enabled = false;
+    return;
+  }
+
+  snprintf(path, sizeof(path), "%s/%016lx.ck", dir, cache_key(counter_initial));
+
+  if (access(path, R_OK) == 0) {
+    checkpoint_load(path, false);
+    cache_hit = true;
+  }
+
+  checkpoint_filename = path;
+}
+
+// report the cached trials as if they were just run
+void cache_replay(void)
+{
+  uint32_t n = (checkpoint_trials < trials) ? checkpoint_trials : trials;
+  char*    s = checkpoint_names;
+
+  for(uint32_t i=0; i<checkpoint_npval; i++) {
+    bbattery_TestNames[i] = s;
+    s += strlen(s)+1;
+  }
+
+  bbattery_NTests = (int)checkpoint_npval;
+
+  for(trial_num=0; trial_num<n; trial_num++) {
+    memcpy(bbattery_pVal, checkpoint_pval+trial_num*checkpoint_npval, checkpoint_npval*sizeof(double));
+    report();
+    if (second_enabled) second_update();
+  }
+
+  // the counter is past the cached trials
+  trial_num = checkpoint_trials;
+}
+
+//*****************************************************************************
+// p-value log (--log): each trial appends a 'plog_block_t' and its
+// p-values with one write to a file opened for append. So concurrent runs
+// can share a log. See plog.c for the reader.
+
+char*    plog_filename = NULL;
+int      plog_fd       = -1;
+uint64_t plog_config;
+
+void plog_open(void)
+{
+  plog_fd = open(plog_filename, O_WRONLY|O_CREAT|O_APPEND, 0644);
+
+  if (plog_fd < 0) {
+    fprintf(stderr, FAIL "error:" ENDC " couldn't open log '%s'\n", plog_filename);
+    exit(-1);
+  }
+
+  plog_config = cache_key(counter_initial);
+}
+
+void plog_write(void)
+{
+  uint32_t n = (uint32_t)bbattery_NTests;
+  uint8_t  buffer[sizeof(plog_block_t) + sizeof(double)*PERF_MAX_STAT];
+
+  if (n > PERF_MAX_STAT) n = PERF_MAX_STAT;
+
+  size_t   len = sizeof(plog_block_t) + n*sizeof(double);
+
+  plog_block_t block = {
+    .magic   = PLOG_MAGIC,
+    .count   = n,
+    .config  = plog_config,
+    .trial   = trial_num,
+    .battery = battery
+  };
+
+  memcpy(buffer, &block, sizeof(block));
+  memcpy(buffer+sizeof(block), bbattery_pVal, n*sizeof(double));
+
+  if (write(plog_fd, buffer, len) != (ssize_t)len)
+    fprintf(stderr, WARNING "warning" ENDC ": log write failed\n");
+}
+
+bool testu01out = false;
+
+static void print_state(void* UNUSED s)
+{
+  printf("  counter = 0x%016lx\n", next_counter());
+}
+
+unif01_Gen gen_lo = {
+  .name    = "low bits",
+  .GetU01  = &next_lo_f64,
+  .GetBits = &next_lo_u32,
+  .Write   = &print_state
+};
+
+unif01_Gen gen_hi = {
+  .name    = "hi bits",
+  .GetU01  = &next_hi_f64,
+  .GetBits = &next_hi_u32,
+  .Write   = &print_state
+};
+
+unif01_Gen gen_rev = {
+  .name    = "bitreversed",
+  .GetU01  = &next_rev_f64,
+  .GetBits = &next_rev_u32,
+  .Write   = &print_state
+};
+
+unif01_Gen gen_32 = {
+  .name    = "32-bit",
+  .GetU01  = &next_32_f64,
+  .GetBits = &next_lo_u32,
+  .Write   = &print_state
+};
+
+unif01_Gen gen_rev_32 = {
+  .name    = "32-bit bitreversed",
+  .GetU01  = &next_rev_32_f64,
+  .GetBits = &next_rev_32_u32,
+  .Write   = &print_state
+};
+
+unif01_Gen gen_demand = {
+  .name    = "demand counting",
+  .GetU01  = &demand_next_f64,
+  .GetBits = &demand_next_u32,
+  .Write   = &print_state
+};
+
+unif01_Gen* gen = &gen_lo;
+
+void help_options(char* name)
+{
+  printf("Usage: %s [OPTIONS] [FILE]\n", name);
+  printf("\n");
+  printf("\n Batteries:\n" 
+	 "  --alphabit[=BLOCKS]  (default)\n"
+	 "  --block[=BLOCKS]     block alphabit\n"
+	 "  --rabbit[=BLOCKS]    \n"
+	 "  --smallcrush         smallcrush file input requires textfile of\n"
+	 "                       doubles on [0,1). I've never tried it.\n"
+	 "  --crush              crush can't be run on a file\n");
+  printf("\n p-value limits:     thresholds to display statistic results\n"
+	 "  --pshow=[VALUE]      display              (disabled by default)\n" 
+	 "  --psus=[VALUE]       report as suspicious (default = 0.001)\n" 
+	 "  --pfail=[VALUE]      report as fail       (default = 2^(-40))\n");
+  printf("\n TestU01 Output:     any of these disable this program's output\n" 
+	 "                       and uses TestU01's internal reporting instead\n" 
+	 "  --short                summaries per trial only\n"
+	 "  --verbose            \n"
+	 "  --collectors         \n"
+	 "  --classes            \n"
+	 "  --counters           \n");
+  printf("\n Sampling            only used for non-file runs\n"
+	 "  --hi                 upper 32 bits fed to tests\n"
+	 "  --lo                 lower 32 bits fed to tests\n"
+	 "  --reversed           bit-reversed output fed to tests\n"
+	 "  --fundamental        Weyl sequence constant is one (default)\n"
+	 "  --increment=VALUE    Weyl sequence constant (odd integer)\n"
+	 "  --phi                Weyl sequence constant is golden ratio\n"
+	 "  --counter=VALUE      Weyl sequence inital value (default is random)\n"
+	 "  --delta=D            differential: hash(x)^hash(x+D) is fed to tests.\n"
+	 "                       D is VALUE (x+VALUE), ^VALUE (x^VALUE), inc or\n"
+	 "                       K*inc (the Weyl constant)\n");
+  printf("\n 32-bit finalizers   input is the counter mod 2^32. An odd increment\n"
+	 "                       walks the full permutation and even a subset\n"
+	 "  --hash32=[NAME]      select (no NAME lists)\n"
+	 "  --full               alphabit/block/rabbit size is one full period\n");
+  printf("\n Runtime finalizer\n"
+	 "  --xsm3=S0,M0,S1,M1,S2 xorshift_mul_3 with these parameters. runs at\n"
+	 "                       the speed of the compiled-in versions\n"
+	 "  --jit=SPEC           compile (with $CC) and load a finalizer. SPEC is\n"
+	 "                       S0,M0,S1,M1,S2, an expression in 'x' or a body\n"
+	 "                       with return. cached in ~/.cache/mini_testu01/jit\n"
+	 "  --plugin=PATH        finalizer and/or generator from a shared object\n"
+	 "                       (see plugin.h)\n"
+	 "  --compose=SPEC       stage list, ex: xsr:33,mul:K,crc,xsr:31. stages\n"
+	 "                       xsr/xsl/rot:N, mul/add/xor/mx/sqr:K and crc[:K]\n");
+  printf("\n Other\n"
+	 "  --demand[=FILE]      count the samples drawn per test (single trial)\n"
+	 "                       and write the table to FILE (for makedata)\n"
+	 "  --perf               hardware counters (Linux perf_event_open) per\n"
+	 "                       test, battery and generator refill\n"
+	 "  --progress[=SECONDS] samples/sec, hash time share and ETA to stderr\n"
+	 "                       every SECONDS (default 5)\n"
+	 "  --expect=FILE        per trial demand for the ETA from a --demand table\n"
+	 "  --checkpoint=FILE    save state after each trial\n"
+	 "  --resume=FILE        continue a checkpointed run (same options) from\n"
+	 "                       the next trial. --trials can be raised\n"
+	 "  --cache[=DIR]        reuse results of identical runs (needs --counter\n"
+	 "                       to be useful). default ~/.cache/mini_testu01\n"
+	 "  --log=FILE           append per trial p-values (binary, see plog)\n"
+	 "  --second             KS & AD tests of each statistic's p-values\n"
+	 "                       across trials\n"
+	 "  --stop               end at the first trial with a failure\n");
+  printf("\n Comparison          --hash=all or --hash=NAME,NAME,... runs each\n"
+	 "                       (same options & counter) and ranks them\n"
+	 "  --jobs=N             concurrent runs (default # of processors)\n"
+	 "  --tournament[=FILE]  successive halving of the --hash list (default\n"
+	 "                       all) and/or xorshift_mul_3 parameters in FILE\n"
+	 "                       from Alphabit (--alphabit=BLOCKS is the start)\n"
+	 "                       doubling each round up to SmallCrush & Crush\n"
+	 "  --stages[=N]         avalanche (N inputs, default 2^16) and battery of\n"
+	 "                       each round prefix of the xorshift_mul_3 or\n"
+	 "                       --compose finalizer\n"
+	 "  --diff[=N]           XOR difference statistics (N inputs, default 2^20)\n"
+	 "                       of each item of --delta=D,D,... (default inc)\n");
+
+  exit(0);
+}
+
+
+void battery_set(uint32_t id)
+{
+  battery = id;
+
+  if (optarg) {
+    // alphabit & rabbit takes an optional argument
+    char*    end;
+    uint64_t val = strtoul(optarg, &end, 0);
+
+    if (end[0] == 0) {
+      double bits = (double)val * 64.0;
+
+      if (bits >= 512.0) {
+	battery_bits     = bits;
+	battery_bits_set = true;
+      }
+      else {
+	printf("blocks=%s ignored. >= 8 required\n", optarg);
+      }
+    }
+    else printf("warning: skipping block argument %s\n", optarg);
+  }
+}
+
+void parse_options(int argc, char **argv)
+{
+  static struct option long_options[] = {
+    {"alphabit",   optional_argument, 0, 'a'},
+    {"block",      optional_argument, 0, 'b'},
+    {"rabbit",     optional_argument, 0, 'r'},
+    {"smallcrush", no_argument,       0, 's'},
     {"crush",      no_argument,       0, 'c'},
-    {"hi",         no_argument,       0, 'h'},
-    {"lo",         no_argument,       0, 'l'},
-    {"reversed",   no_argument,       0, 'r'},
+    {"hi",         no_argument,       0, 'H'},
+    {"lo",         no_argument,       0, 'L'},
+    {"reversed",   no_argument,       0, 'R'},
     {"fundamental",no_argument,       0, 'f'},
     {"phi",        no_argument,       0, 'p'},
     {"counter",    required_argument, 0, 'x'},
     {"increment",  required_argument, 0, 'i'},
     {"trials",     required_argument, 0, 't'},
     {"hash",       optional_argument, 0,  5 },
+    {"hash32",     optional_argument, 0,  6 },
+    {"full",       no_argument,       0,  7 },
+    {"perf",       no_argument,       0,  8 },
+    {"demand",     optional_argument, 0,  9 },
+    {"progress",   optional_argument, 0, 10 },
+    {"expect",     required_argument, 0, 11 },
+    {"checkpoint", required_argument, 0, 12 },
+    {"resume",     required_argument, 0, 13 },
+    {"cache",      optional_argument, 0, 14 },
+    {"log",        required_argument, 0, 15 },
+    {"second",     no_argument,       0, 16 },
+    {"stop",       no_argument,       0, 17 },
+    {"jobs",       required_argument, 0, 18 },
+    {"tournament", optional_argument, 0, 19 },
+    {"xsm3",       required_argument, 0, 20 },
+    {"jit",        required_argument, 0, 21 },
+    {"plugin",     required_argument, 0, 22 },
+    {"compose",    required_argument, 0, 23 },
+    {"stages",     optional_argument, 0, 24 },
+    {"delta",      required_argument, 0, 25 },
+    {"diff",       optional_argument, 0, 26 },
     
     {"short",      no_argument,       0,  0 },
     {"verbose",    no_argument,       0, 'v'},
@@ -783,76 +1870,1129 @@ void parse_options(int argc, char **argv)
   while (1) {
     int option_index = 0;
 
-    c = getopt_long(argc, argv, "", long_options, &option_index);
-    
-    if (c == -1)
-      break;
-    
-    switch (c) {
-    case 'x':
-    case 't':
-      {
-	char*    end;
-	uint64_t val = strtoul(optarg, &end, 0);
+    c = getopt_long(argc, argv, "", long_options, &option_index);
+    
+    if (c == -1)
+      break;
+    
+    switch (c) {
+    case 'x':
+    case 't':
+    case 'i':
+      {
+	char*    end;
+	uint64_t val = strtoul(optarg, &end, 0);
+
+	if (c == 't') {
+	  if (val != 0) trials = (uint32_t)val;
+	}
+	else if (c == 'i')
+	  data.inc = val;
+	else
+	  data.counter = val;
+      }
+      break;
+
+    case 'v':swrite_Basic      = TRUE; testu01out = true;  break;
+    case 0:                            testu01out = true;  break;
+    case 1:  swrite_Parameters = TRUE; testu01out = true;  break;
+    case 2:  swrite_Collectors = TRUE; testu01out = true;  break;
+    case 3:  swrite_Classes    = TRUE; testu01out = true;  break;
+    case 4:  swrite_Counters   = TRUE; testu01out = true;  break;
+
+    case 5:
+      if (optarg) {
+	if (strcmp(optarg, "all") == 0 || strchr(optarg, ',')) {
+	  compare_list = optarg;
+	  break;
+	}
+	bit_finalizer  = get_hash(optarg);
+	break;
+      }
+      print_xorshift_mul_3();
+      exit(0);
+      break;
+
+    case 6:
+      if (optarg) {
+	if (get_hash32(optarg)) break;
+	exit(-1);
+      }
+      print_xorshift_mul_3_32();
+      exit(0);
+      break;
+
+    case 7: full_period  = true; break;
+    case 8: perf_enabled = true; break;
+    case 9: demand_enabled = true; demand_filename = optarg; break;
+
+    case 10:
+      progress_enabled = true;
+      if (optarg) {
+	uint32_t v = (uint32_t)strtoul(optarg, NULL, 0);
+	if (v != 0) progress_period = v;
+      }
+      break;
+
+    case 11: progress_expect = optarg; break;
+    case 12: checkpoint_filename = optarg; break;
+    case 13: resume_filename     = optarg; break;
+    case 14: cache_enabled = true; cache_dir = optarg; break;
+    case 15: plog_filename = optarg; break;
+    case 16: second_enabled = true; break;
+    case 17: second_stop    = true; break;
+    case 18: compare_jobs   = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 19: tournament_enabled = true; tournament_file = optarg; break;
+
+    case 20:
+      {
+	static char      name[96];
+	xorshift_mul_3_t d;
+
+	if (!parse_xorshift_mul_3(optarg, &d)) {
+	  fprintf(stderr, FAIL "error:" ENDC " --xsm3 expects s0,m0,s1,m1,s2 (shifts on [1,63])\n");
+	  exit(-1);
+	}
+
+	if (!(d.m0 & d.m1 & 1))
+	  fprintf(stderr, WARNING "warning" ENDC ": even multiplier. not a bijection\n");
+
+	// canonical spelling: it's the name used by --cache/--log
+	snprintf(name, sizeof(name), "xsm3:%u,0x%016lx,%u,0x%016lx,%u", d.s0, d.m0, d.s1, d.m1, d.s2);
+	d.name = name;
+	set_xorshift_mul_3_gen(&d);
+      }
+      break;
+
+    case 21: if (!jit_hash(optarg))     exit(-1); break;
+    case 22: if (!plugin_load(optarg))  exit(-1); break;
+    case 23: if (!compose_hash(optarg)) exit(-1); break;
+
+    case 24:
+      stages_enabled = true;
+      if (optarg) stages_samples = (uint32_t)strtoul(optarg, NULL, 0);
+      if (stages_samples == 0) stages_samples = 1;
+      break;
+
+    case 25: delta_list = optarg; break;
+
+    case 26:
+      diff_enabled = true;
+      if (optarg) diff_samples = (uint32_t)strtoul(optarg, NULL, 0);
+      if (diff_samples == 0) diff_samples = 1;
+      break;
+
+    case 'H': sample = sample_hi;  break;
+    case 'L': sample = sample_lo;  break;
+    case 'R': sample = sample_rev; break;
+      
+    case 'a': battery_set(run_alphabit);         break;
+    case 'b': battery_set(run_block);            break;
+    case 'r': battery_set(run_rabbit);           break;
+    case 's': battery_set(run_smallcrush);       break;
+    case 'c': battery_set(run_crush);            break;
+    case 'p': data.inc     = 0x9e3779b97f4a7c15; break;
+    case '?': help_options(argv[0]);             break;
+      
+    default:
+      printf("internal error: what option? %c (%u)\n", c,c);
+    }
+  }
+
+  if (optind == argc) return;
+
+  // get filename and silently ignore anything past it
+  filename = argv[optind];
+
+  double file_bits = (double)get_file_size(filename) * 8.0;
+
+  // an explicit size (say from --demand & makedata --demand) is used as is
+  if (!battery_bits_set)
+    battery_bits = file_bits;
+
+  if (file_bits < 4096.0 || file_bits < battery_bits) {
+    printf("error: datafile too small\n");
+    exit(-1);
+  }
+}
+
+// period of the 32-bit input sequence: 2^(32-tz(inc))
+double period_32(void)
+{
+  uint32_t inc = (uint32_t)data.inc;
+
+  return (inc != 0) ? ldexp(1.0, 32-__builtin_ctz(inc)) : 1.0;
+}
+
+static void select_generator_source(void);
+
+void select_generator(void)
+{
+  select_generator_source();
+
+  if (sample == sample_rev) {
+    refill_rev_base = refill;
+    refill          = refill_rev;
+  }
+}
+
+static void select_generator_source(void)
+{
+  unif01_Gen* views[] = { [sample_lo]=&gen_lo, [sample_hi]=&gen_hi, [sample_rev]=&gen_rev };
+
+  if (bit_finalizer_32 == NULL) {
+    gen = views[sample];
+
+    if (plugin && plugin->next && bit_finalizer_type == hash_type_plugin) {
+      refill              = refill_prng;
+      prng_plugin_enabled = true;
+
+      if (resume_filename || cache_enabled)
+	fprintf(stderr, WARNING "warning" ENDC ": plugin generator is reseeded from the counter on"
+		" --resume/--cache. not the same sequence as a single run\n");
+      return;
+    }
+
+    if (delta_source) refill = refill_diff;
+
+    if ((data.inc & 1) == 0)
+      fprintf(stderr, WARNING "warning" ENDC ": increment should be odd\n");
+
+    if (full_period)
+      fprintf(stderr, WARNING "warning" ENDC ": --full ignored. only for 32-bit finalizers\n");
+    return;
+  }
+
+  refill = refill_32;
+
+  if (sample == sample_hi) {
+    fprintf(stderr, WARNING "warning" ENDC ": no high bits in a 32-bit finalizer. using low\n");
+    sample = sample_lo;
+  }
+
+  gen = (sample == sample_rev) ? &gen_rev_32 : &gen_32;
+
+  if (full_period) {
+    if (battery == run_alphabit || battery == run_block || battery == run_rabbit)
+      battery_bits = 32.0*period_32();
+    else
+      fprintf(stderr, WARNING "warning" ENDC ": --full ignored. fixed size battery\n");
+  }
+}
+
+void pre_trial(void)
+{
+  // the trial loop's counters as seen by the progress thread
+  if (progress_enabled) {
+    __atomic_store_n(&progress_trial,  trial_num, __ATOMIC_RELAXED);
+    __atomic_store_n(&progress_trials, trials,    __ATOMIC_RELAXED);
+  }
+
+  if (!testu01out) dup2(null_stdout, STDOUT_FILENO);
+  if (perf_enabled) perf_trial_begin();
+  if (demand_enabled) pvalue_reset();
+}
+
+void post_trial(void)
+{
+  if (perf_enabled) perf_trial_end();
+
+  if (progress_enabled) {
+    if (progress_measure && trial_num == 0)
+      __atomic_store_n(&progress_demand, progress_samples, __ATOMIC_RELAXED);
+    progress_clear();
+  }
+
+  dup2(real_stdout, STDOUT_FILENO);
+  if (!testu01out) report();
+  if (checkpoint_filename) checkpoint_write();
+  if (plog_fd >= 0) plog_write();
+
+  if (second_enabled) {
+    bool fail = second_update();
+
+    // ends the trial loop
+    if (second_stop && (fail || failure_count != 0))
+      trials = trial_num+1;
+  }
+}
+
+//*****************************************************************************
+// comparison (--hash=all or --hash=A,B,..): each finalizer is run in its
+// own process (TestU01 isn't thread safe) up to --jobs at a time with the
+// same options and initial counter. Results come back over a pipe and are
+// reported as a single ranking. Composes with --second/--stop (stops
+// failing finalizers early), --cache and --log.
+
+typedef struct {
+  char*    name;
+  pid_t    pid;
+  int      fd;                          // read end of the result pipe
+  bool     done;
+  uint32_t trials;
+  uint32_t statistics;
+  uint32_t suspicious;
+  uint32_t failed;
+  uint32_t second;                      // second level flagged statistics
+  double   worst;
+  double   score;                       // mean -ln(2t). ~1 if uniform
+  double   seconds;
+  double   wall;                        // tournament: all rounds
+  uint32_t round;                       // tournament: last round run
+  bool     custom;                      // 'params' rather than by name
+  xorshift_mul_3_t params;
+} compare_t;
+
+extern void run_trials(void);
+
+compare_t* compare       = NULL;
+uint32_t   compare_count = 0;
+
+static compare_t* compare_add(char* name)
+{
+  compare = realloc(compare, (compare_count+1)*sizeof(compare_t));
+
+  if (!compare) {
+    fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
+    exit(-1);
+  }
+
+  memset(compare+compare_count, 0, sizeof(compare_t));
+  compare[compare_count].name = name;
+
+  return compare+compare_count++;
+}
+
+static void compare_build(void)
+{
+  if (strcmp(compare_list, "all") == 0) {
+    for(uint32_t i=0; i<xorshift_mul_3_def_len; i++) compare_add(xorshift_mul_3_def[i].name);
+    for(uint32_t i=0; i<hash_builtin_def_len;   i++) compare_add(hash_builtin_def[i].name);
+    return;
+  }
+
+  for(char* name = strtok(compare_list, ","); name; name = strtok(NULL, ",")) {
+    get_hash(name);
+
+    if (strcmp(bit_finalizer_name, name) != 0) exit(-1);
+
+    compare_add(name);
+  }
+}
+
+static noreturn void compare_child(compare_t* c, int fd)
+{
+  uint64_t t0 = get_timestamp();
+
+  if (c->custom)
+    set_xorshift_mul_3_gen(&c->params);
+  else if (strncmp(c->name, "compose:", 8) == 0)
+    compose_hash(c->name+8);
+  else
+    get_hash(c->name);
+
+  // everything is discarded. only the summary is returned
+  dup2(null_stdout, STDOUT_FILENO);
+  real_stdout = null_stdout;
+
+  if (cache_enabled) {
+    cache_open();
+    if (cache_hit) cache_replay();
+  }
+
+  if (plog_fd >= 0) plog_config = cache_key(counter_initial);
+
+  run_trials();
+
+  c->trials     = trial_num;
+  c->statistics = statistic_count;
+  c->suspicious = suspicious_count;
+  c->failed     = failure_count;
+  c->worst      = worst_t;
+  c->score      = score_n ? score_sum/(double)score_n : 0.0;
+
+  for(uint32_t i=0; second_enabled && i<PERF_MAX_STAT; i++)
+    c->second += second_sketch[i].flagged;
+  c->seconds    = 1e-9*(double)(get_timestamp()-t0);
+
+  ssize_t r = write(fd, c, sizeof(*c));
+
+  _exit(r == (ssize_t)sizeof(*c) ? 0 : 1);
+}
+
+static bool compare_start(compare_t* c)
+{
+  int p[2];
+
+  if (pipe(p) != 0) return false;
+
+  fflush(stdout);
+  fflush(stderr);
+
+  c->pid = fork();
+
+  if (c->pid == 0) {
+    close(p[0]);
+    compare_child(c, p[1]);
+  }
+
+  close(p[1]);
+
+  if (c->pid < 0) { close(p[0]); return false; }
+
+  c->fd = p[0];
+
+  return true;
+}
+
+static void compare_finish(compare_t** set, uint32_t n, pid_t pid, int status)
+{
+  for(uint32_t i=0; i<n; i++) {
+    compare_t* c = set[i];
+
+    if (c->pid != pid || c->done) continue;
+
+    compare_t r;
+    char*     name = c->name;
+    int       fd   = c->fd;
+
+    // only the results are taken from the child's copy
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && read(fd, &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+      *c      = r;
+      c->name = name;
+    }
+    else {
+      fprintf(stderr, WARNING "warning" ENDC ": %s didn't complete\n", name);
+      c->failed = UINT32_MAX;
+      c->worst  = 0.0;
+      c->score  = INFINITY;
+    }
+
+    close(fd);
+    c->done = true;
+    c->pid  = pid;
+    c->fd   = -1;
+    fprintf(stderr, "  done: %s\n", name);
+    return;
+  }
+}
+
+static int compare_cmp(const void* a, const void* b)
+{
+  const compare_t* x = a;
+  const compare_t* y = b;
+
+  if (x->failed     != y->failed)     return (x->failed     < y->failed)     ? -1 : 1;
+  if (x->second     != y->second)     return (x->second     < y->second)     ? -1 : 1;
+  if (x->suspicious != y->suspicious) return (x->suspicious < y->suspicious) ? -1 : 1;
+  if (x->worst      != y->worst)      return (x->worst      > y->worst)      ? -1 : 1;
+
+  return 0;
+}
+
+static uint32_t compare_jobs_get(void)
+{
+  if (compare_jobs == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    compare_jobs = (n > 0) ? (uint32_t)n : 1;
+  }
+
+  return compare_jobs;
+}
+
+// runs the current configuration for each of 'set' on the worker pool
+static void compare_pool(compare_t** set, uint32_t n)
+{
+  uint32_t jobs    = compare_jobs_get();
+  uint32_t next    = 0;
+  uint32_t running = 0;
+
+  for(uint32_t i=0; i<n; i++) set[i]->done = false;
+
+  while (next < n || running != 0) {
+    while (running < jobs && next < n) {
+      if (!compare_start(set[next])) {
+	fprintf(stderr, FAIL "error:" ENDC " couldn't start process\n");
+	exit(-1);
+      }
+      next++; running++;
+    }
+
+    int   status;
+    pid_t pid = wait(&status);
+
+    if (pid < 0) break;
+
+    compare_finish(set, n, pid, status);
+    running--;
+  }
+}
+
+static compare_t** compare_set(void)
+{
+  compare_t** set = malloc(compare_count*sizeof(compare_t*));
+
+  if (!set) {
+    fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
+    exit(-1);
+  }
+
+  for(uint32_t i=0; i<compare_count; i++) set[i] = compare+i;
+
+  return set;
+}
+
+void compare_run(void)
+{
+  compare_t** set = compare_set();
+
+  printf("compare: %u finalizers, %u jobs\n\n", compare_count, compare_jobs_get());
+
+  compare_pool(set, compare_count);
+  free(set);
+
+  qsort(compare, compare_count, sizeof(compare_t), compare_cmp);
+
+  char* div = table.style->div;
+
+  mini_report_table_init(&table, 8, "rank","      finalizer       "," trials ","suspicious","   fail   ","  worst t   ","  wall s  ", " 2nd level ");
+
+  if (!second_enabled) table.num_col = 7;
+
+  mini_report_table_header(stdout, &table);
+
+  for(uint32_t i=0; i<compare_count; i++) {
+    compare_t* c = compare+i;
+
+    printf("%s%*u%s %-*s%s%*u%s%*u%s",
+	   div, table.col[0].width,   i+1,
+	   div, table.col[1].width-1, c->name,
+	   div, table.col[2].width,   c->trials,
+	   div, table.col[3].width,   c->suspicious,
+	   div);
+
+    if (c->failed != UINT32_MAX)
+      printf("%*u", table.col[4].width, c->failed);
+    else
+      printf("%*s", table.col[4].width, "error");
+
+    printf("%s%*e%s%*.2f%s",
+	   div, table.col[5].width, c->worst,
+	   div, table.col[6].width, c->seconds,
+	   div);
+
+    if (second_enabled)
+      printf("%*u%s", table.col[7].width, c->second, div);
+
+    printf("\n");
+  }
+
+  mini_report_table_end(stdout, &table);
+}
+
+//*****************************************************************************
+// tournament (--tournament[=FILE]): successive halving over the candidates
+// (--hash list/all and/or xorshift_mul_3 parameters "s0,m0,s1,m1,s2" one
+// per line of FILE). Each round runs all survivors on the worker pool
+// and keeps the better half (failures, second level flags then mean
+// score -ln(2t) which is ~1 for uniform p-values). Early rounds are
+// Alphabit with the size doubling each round, the last two SmallCrush
+// then Crush (or just SmallCrush if that was the chosen battery).
+
+static int tournament_cmp(const void* a, const void* b)
+{
+  const compare_t* x = *(const compare_t* const*)a;
+  const compare_t* y = *(const compare_t* const*)b;
+
+  if (x->round      != y->round)      return (x->round      > y->round)      ? -1 : 1;
+  if (x->failed     != y->failed)     return (x->failed     < y->failed)     ? -1 : 1;
+  if (x->second     != y->second)     return (x->second     < y->second)     ? -1 : 1;
+  if (x->score      != y->score)      return (x->score      < y->score)      ? -1 : 1;
+
+  return 0;
+}
+
+static void tournament_load(void)
+{
+  FILE* file = fopen(tournament_file, "r");
+  char  line[512];
+
+  if (!file) {
+    fprintf(stderr, FAIL "error:" ENDC " couldn't open '%s'\n", tournament_file);
+    exit(-1);
+  }
+
+  while (fgets(line, sizeof(line), file)) {
+    xorshift_mul_3_t d;
+    char*            s = line + strspn(line, " \t");
+
+    s[strcspn(s, " \t\r\n#")] = 0;
+
+    if (*s == 0) continue;
+
+    if (!parse_xorshift_mul_3(s, &d) || !(d.m0 & d.m1 & 1)) {
+      fprintf(stderr, WARNING "warning" ENDC ": skipping '%s' (malformed or even multiplier)\n", s);
+      continue;
+    }
+
+    compare_t* c = compare_add(strdup(s));
+
+    d.name    = c->name;
+    c->params = d;
+    c->custom = true;
+  }
+
+  fclose(file);
+}
+
+void tournament_run(void)
+{
+  compare_t** set    = compare_set();
+  uint32_t    n      = compare_count;
+  uint32_t    top    = (battery == run_smallcrush) ? run_smallcrush : run_crush;
+  uint32_t    rounds = 0;
+  double      bits   = battery_bits;
+
+  while ((1u << rounds) < n) rounds++;
+  if (rounds == 0) rounds = 1;
+
+  printf("tournament: %u candidates, %u rounds, %u jobs\n\n", n, rounds, compare_jobs_get());
+
+  for(uint32_t r=0; r<rounds && n > 1; r++) {
+    uint32_t left = rounds-1-r;      // rounds after this one
+
+    if (left == 0)
+      battery = top;
+    else if (left == 1 && top == run_crush)
+      battery = run_smallcrush;
+    else {
+      battery      = run_alphabit;
+      battery_bits = ldexp(bits, (int)r);
+    }
+
+    uint32_t count = n;
+
+    for(uint32_t i=0; i<n; i++) set[i]->round = r;
+
+    compare_pool(set, n);
+
+    for(uint32_t i=0; i<n; i++) set[i]->wall += set[i]->seconds;
+
+    qsort(set, n, sizeof(compare_t*), tournament_cmp);
+
+    // keep the better half (survivors get the next round)
+    n = (n+1)/2;
+
+    char size[32] = "";
+
+    if (battery == run_alphabit)
+      snprintf(size, sizeof(size), "2^%.0f bits", log2(battery_bits));
+
+    printf("round %u: %-14s %-12s %4u -> %u\n", r, battery_info[battery].name, size, count, n);
+
+    for(uint32_t i=0; i<n; i++) set[i]->round = r+1;
+  }
+
+  // all candidates by how far they got then score
+  for(uint32_t i=0; i<compare_count; i++) set[i] = compare+i;
+
+  qsort(set, compare_count, sizeof(compare_t*), tournament_cmp);
+
+  char* div = table.style->div;
+
+  printf("\n");
+  mini_report_table_init(&table, 8, "rank","candidate","round","suspicious","   fail   "," 2nd level ","  score   ","  wall s  ");
+  mini_report_set_col_width(&table, 1, 48, mini_report_justify_center);
+  mini_report_table_header(stdout, &table);
+
+  for(uint32_t i=0; i<compare_count; i++) {
+    compare_t* c = set[i];
+
+    printf("%s%*u%s %-*s%s%*u%s%*u%s",
+	   div, table.col[0].width,   i+1,
+	   div, table.col[1].width-1, c->name,
+	   div, table.col[2].width,   c->round,
+	   div, table.col[3].width,   c->suspicious,
+	   div);
+
+    if (c->failed != UINT32_MAX)
+      printf("%*u", table.col[4].width, c->failed);
+    else
+      printf("%*s", table.col[4].width, "error");
+
+    printf("%s%*u%s%*.4f%s%*.2f%s\n",
+	   div, table.col[5].width, c->second,
+	   div, table.col[6].width, c->score,
+	   div, table.col[7].width, c->wall,
+	   div);
+  }
+
+  mini_report_table_end(stdout, &table);
+
+  // the winner as code (parameter candidates)
+  if (set[0]->custom) {
+    xorshift_mul_3_t w = set[0]->params;
+
+    w.name = "xsm3_winner";
+
+    printf("\n");
+    pretty_print_xorshift_mul_3(&w, 0);
+  }
+
+  free(set);
+}
+
+//*****************************************************************************
+// stage prefixes (--stages[=N]): the finalizer (xorshift_mul_3 or a
+// --compose list) as a composition split into rounds, each ending at a
+// nonlinear step. Every prefix (round 1, rounds 1-2, ... full) gets a
+// sampled avalanche (sac_acc_t as search.c: 4N*mean(bias^2) is ~1 for
+// random, plus max |bias|) with all prefixes computed in one pass over
+// the same input blocks, and a battery run (comparison pool) so the weak
+// round shows up in a single run.
+
+#define STAGES_BLOCK 128
+
+uint32_t stages_count = 0;
+uint32_t stages_end[COMPOSE_MAX_OPS];
+double   stages_fitness[COMPOSE_MAX_OPS];
+double   stages_peak[COMPOSE_MAX_OPS];
+char*    stages_added[COMPOSE_MAX_OPS];
+
+static void stages_build(void)
+{
+  char spec[4096];
+
+  // xorshift_mul_3 are expressed as a composition
+  if (bit_finalizer_type == hash_type_xsm3 && xorshift_mul_3_current) {
+    const xorshift_mul_3_t* d = xorshift_mul_3_current;
+    snprintf(spec, sizeof(spec), "xsr:%u,mul:0x%016lx,xsr:%u,mul:0x%016lx,xsr:%u", d->s0, d->m0, d->s1, d->m1, d->s2);
+    compose_hash(spec);
+  }
+  else if (bit_finalizer_type != hash_type_compose) {
+    fprintf(stderr, FAIL "error:" ENDC " --stages needs an xorshift_mul_3 (--hash/--xsm3) or --compose finalizer\n");
+    exit(-1);
+  }
+
+  stages_count = compose_rounds(stages_end);
+
+  for(uint32_t i=0; i<stages_count; i++) {
+    compose_spec(spec, sizeof(spec), i ? stages_end[i-1] : 0, stages_end[i]);
+    stages_added[i] = strdup(spec);
+
+    compose_spec(spec, sizeof(spec), 0, stages_end[i]);
+
+    char* name = malloc(strlen(spec)+9);
+    sprintf(name, "compose:%s", spec);
+    compare_add(name);
+  }
+}
+
+static void stages_avalanche(void)
+{
+  uint32_t   np      = stages_count;
+  uint32_t   nblocks = (stages_samples + STAGES_BLOCK-1)/STAGES_BLOCK;
+  uint64_t   inc     = data.inc;
+  sac_acc_t* total   = calloc(np, sizeof(sac_acc_t));
+
+  if (!total) {
+    fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
+    exit(-1);
+  }
+
+  #pragma omp parallel
+  {
+    sac_acc_t* acc = calloc(np, sizeof(sac_acc_t));
+    uint64_t (*hx)[STAGES_BLOCK] = malloc(np*sizeof(*hx));
+    uint64_t x[STAGES_BLOCK];
+    uint64_t y[STAGES_BLOCK];
+    uint64_t d[STAGES_BLOCK];
+
+    if (!acc || !hx) {
+      fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
+      exit(-1);
+    }
+
+    #pragma omp for schedule(dynamic)
+    for(uint32_t k=0; k<nblocks; k++) {
+      uint64_t c = counter_initial + (uint64_t)k*STAGES_BLOCK*inc;
+
+      for(uint32_t i=0; i<STAGES_BLOCK; i++) { x[i] = c; c += inc; }
+
+      // the unflipped output after each round
+      for(uint32_t p=0; p<np; p++)
+	compose_run(hx[p], p ? hx[p-1] : x, STAGES_BLOCK, p ? stages_end[p-1] : 0, stages_end[p]);
+
+      for(uint32_t b=0; b<64; b++) {
+	uint64_t bit = UINT64_C(1) << b;
+
+	for(uint32_t i=0; i<STAGES_BLOCK; i++) y[i] = x[i] ^ bit;
+
+	for(uint32_t p=0; p<np; p++) {
+	  compose_run(y, y, STAGES_BLOCK, p ? stages_end[p-1] : 0, stages_end[p]);
+
+	  for(uint32_t i=0; i<STAGES_BLOCK; i++) d[i] = hx[p][i] ^ y[i];
+
+	  sac_acc_add(acc+p, b, d, STAGES_BLOCK);
+	}
+      }
+    }
+
+    #pragma omp critical
+    {
+      for(uint32_t p=0; p<np; p++)
+	sac_acc_merge(total+p, acc+p);
+    }
+
+    free(acc); free(hx);
+  }
+
+  uint64_t n = (uint64_t)nblocks*STAGES_BLOCK;
+
+  for(uint32_t p=0; p<np; p++)
+    stages_fitness[p] = sac_acc_fitness(total+p, 64, n, stages_peak+p);
+
+  free(total);
+}
+
+void stages_run(void)
+{
+  printf("stages:  %u rounds, %u avalanche inputs, %u jobs\n\n", stages_count,
+	 (stages_samples + STAGES_BLOCK-1)/STAGES_BLOCK*STAGES_BLOCK, compare_jobs_get());
+
+  stages_avalanche();
+
+  compare_t** set = compare_set();
+  compare_pool(set, compare_count);
+  free(set);
+
+  char* div = table.style->div;
+
+  mini_report_table_init(&table, 8, "round","             added stages              ",
+			 " avalanche ","  max bias  ","suspicious","   fail   ","  worst t   ", " 2nd level ");
+
+  if (!second_enabled) table.num_col = 7;
+
+  mini_report_table_header(stdout, &table);
+
+  for(uint32_t i=0; i<stages_count; i++) {
+    compare_t* c = compare+i;
+
+    printf("%s%*u%s %-*s%s%*.3f%s%*.6f%s%*u%s",
+	   div, table.col[0].width,   i+1,
+	   div, table.col[1].width-1, stages_added[i],
+	   div, table.col[2].width,   stages_fitness[i],
+	   div, table.col[3].width,   stages_peak[i],
+	   div, table.col[4].width,   c->suspicious,
+	   div);
+
+    if (c->failed != UINT32_MAX)
+      printf("%*u", table.col[5].width, c->failed);
+    else
+      printf("%*s", table.col[5].width, "error");
 
-	if (c == 't') {
-	  if (val != 0) trials = (uint32_t)val;
-	}
-	else
-	  data.counter = val;
+    printf("%s%*e%s", div, table.col[6].width, c->worst, div);
+
+    if (second_enabled)
+      printf("%*u%s", table.col[7].width, c->second, div);
+
+    printf("\n");
+  }
+
+  mini_report_table_end(stdout, &table);
+}
+
+//*****************************************************************************
+// differentials (--delta/--diff): for each input relation x -> (x+a)^m
+// of the list the XOR difference hash(x) ^ hash((x+a)^m) over the counter
+// sequence. --delta with one item makes it the source for the battery.
+// --diff is a native measure of each (sampled, in parallel):
+//   bias:   4N*mean(bias^2) of the 64 output bits (~1 for random, same
+//           measure as --stages) and the max |bias|
+//   weight: chi-square of the popcount vs binomial(64,1/2). tails pooled
+//   byte:   chi-square of each byte lane vs uniform. the min of the 8
+//   zero:   count of zero differences (collisions of the related inputs)
+
+#define DIFF_BLOCK 1024
+
+delta_t  deltas[DELTA_MAX];
+uint32_t delta_count = 0;
+
+typedef struct {
+  uint64_t weight[65];
+  uint64_t byte[8][256];
+  uint64_t zero;
+} diff_count_t;
+
+typedef struct {
+  double   bias, peak;
+  double   weight_p;
+  double   byte_p;
+  uint64_t zero;
+} diff_stat_t;
+
+static void delta_setup(void)
+{
+  static char def[] = "inc";
+
+  delta_count = parse_delta_list(delta_list ? delta_list : def, data.inc, deltas, DELTA_MAX);
+
+  if (delta_count == 0) exit(-1);
+
+  if (diff_enabled) return;
+
+  if (delta_count != 1) {
+    fprintf(stderr, FAIL "error:" ENDC " --delta source is a single item (lists are for --diff)\n");
+    exit(-1);
+  }
+
+  if (filename || bit_finalizer_32 || (plugin && plugin->next && bit_finalizer_type == hash_type_plugin)) {
+    fprintf(stderr, FAIL "error:" ENDC " --delta is for the internal 64-bit counter source\n");
+    exit(-1);
+  }
+
+  delta_source = deltas;
+}
+
+// upper tail of chi-square with 'k' degrees of freedom (Wilson-Hilferty.
+// a few digits for k >= 10 which is plenty to flag with)
+static double chi2_pvalue(double x, double k)
+{
+  double s = 2.0/(9.0*k);
+  double z = (cbrt(x/k)-(1.0-s))/sqrt(s);
+
+  return 0.5*erfc(z*M_SQRT1_2);
+}
+
+static void diff_count(diff_count_t* s, const uint64_t* d, uint32_t n)
+{
+  for(uint32_t i=0; i<n; i++) {
+    uint64_t v = d[i];
+
+    s->zero += (v == 0);
+    s->weight[__builtin_popcountll(v)]++;
+
+    for(uint32_t l=0; l<8; l++)
+      s->byte[l][(v >> (8*l)) & 0xff]++;
+  }
+}
+
+static void diff_stat(diff_stat_t* r, const diff_count_t* s, double n)
+{
+  double sum2 = 0.0, peak = 0.0, chi;
+
+  // bit counts from the byte lanes
+  for(uint32_t b=0; b<64; b++) {
+    uint64_t c = 0;
+
+    for(uint32_t v=0; v<256; v++)
+      if ((v >> (b & 7)) & 1) c += s->byte[b >> 3][v];
+
+    double e = (double)c/n - 0.5;
+    sum2 += e*e;
+    peak  = fmax(peak, fabs(e));
+  }
+
+  r->bias = 4.0*n*sum2/64.0;
+  r->peak = peak;
+
+  // popcount: pool each tail until its expected count is 5
+  double   e[65];
+  uint32_t lo = 0, hi = 64;
+  double   el = 0.0, eh = 0.0;
+  uint64_t ol = 0,   oh = 0;
+
+  for(uint32_t w=0; w<=64; w++)
+    e[w] = n*exp(lgamma(65.0)-lgamma(w+1.0)-lgamma(65.0-w)-64.0*M_LN2);
+
+  for(; lo < 32 && el+e[lo] < 5.0; lo++) { el += e[lo]; ol += s->weight[lo]; }
+  for(; hi > 32 && eh+e[hi] < 5.0; hi--) { eh += e[hi]; oh += s->weight[hi]; }
+
+  // the tails become the end bins
+  el += e[lo]; ol += s->weight[lo];
+  eh += e[hi]; oh += s->weight[hi];
+
+  if (hi > lo+1) {
+    chi  = ((double)ol-el)*((double)ol-el)/el + ((double)oh-eh)*((double)oh-eh)/eh;
+
+    for(uint32_t w=lo+1; w<hi; w++)
+      chi += ((double)s->weight[w]-e[w])*((double)s->weight[w]-e[w])/e[w];
+
+    r->weight_p = chi2_pvalue(chi, (double)(hi-lo));
+  }
+  else
+    r->weight_p = 1.0;                  // too few inputs
+
+  // byte lanes
+  r->byte_p = 1.0;
+
+  for(uint32_t l=0; l<8; l++) {
+    double eb = n/256.0;
+
+    chi = 0.0;
+
+    for(uint32_t v=0; v<256; v++)
+      chi += ((double)s->byte[l][v]-eb)*((double)s->byte[l][v]-eb)/eb;
+
+    r->byte_p = fmin(r->byte_p, chi2_pvalue(chi, 255.0));
+  }
+
+  r->zero = s->zero;
+}
+
+static void diff_measure(diff_stat_t* r)
+{
+  uint32_t      nd      = delta_count;
+  uint32_t      nblocks = (diff_samples + DIFF_BLOCK-1)/DIFF_BLOCK;
+  uint64_t      inc     = data.inc;
+  diff_count_t* total   = calloc(nd, sizeof(diff_count_t));
+
+  if (!total) {
+    fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
+    exit(-1);
+  }
+
+  #pragma omp parallel
+  {
+    diff_count_t* sum = calloc(nd, sizeof(diff_count_t));
+    uint64_t x[DIFF_BLOCK];
+    uint64_t h[DIFF_BLOCK];
+    uint64_t y[DIFF_BLOCK];
+
+    if (!sum) {
+      fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
+      exit(-1);
+    }
+
+    #pragma omp for schedule(dynamic)
+    for(uint32_t k=0; k<nblocks; k++) {
+      uint64_t c = counter_initial + (uint64_t)k*DIFF_BLOCK*inc;
+
+      for(uint32_t i=0; i<DIFF_BLOCK; i++) { x[i] = c; c += inc; }
+
+      bit_finalizer_batch(h, x, DIFF_BLOCK);
+
+      for(uint32_t j=0; j<nd; j++) {
+	const uint64_t a = deltas[j].add;
+	const uint64_t m = deltas[j].mask;
+
+	for(uint32_t i=0; i<DIFF_BLOCK; i++) y[i] = (x[i] + a) ^ m;
+
+	bit_finalizer_batch(y, y, DIFF_BLOCK);
+
+	for(uint32_t i=0; i<DIFF_BLOCK; i++) y[i] ^= h[i];
+
+	diff_count(sum+j, y, DIFF_BLOCK);
       }
-      break;
+    }
 
-    case 'v':swrite_Basic      = TRUE; testu01out = true;  break;
-    case 0:                            testu01out = true;  break;
-    case 1:  swrite_Parameters = TRUE; testu01out = true;  break;
-    case 2:  swrite_Collectors = TRUE; testu01out = true;  break;
-    case 3:  swrite_Classes    = TRUE; testu01out = true;  break;
-    case 4:  swrite_Counters   = TRUE; testu01out = true;  break;
+    #pragma omp critical
+    {
+      for(uint32_t j=0; j<nd; j++) {
+	uint64_t* d = (uint64_t*)(total+j);
+	uint64_t* s = (uint64_t*)(sum+j);
 
-    case 5:
-      if (optarg) {
-	bit_finalizer  = get_hash(optarg);
-	break;
+	for(size_t i=0; i<sizeof(diff_count_t)/sizeof(uint64_t); i++) d[i] += s[i];
       }
-      print_xorshift_mul_3();
-      exit(0);
-      break;
-      
-    case 'a': battery_set(run_alphabit);         break;
-    case 'b': battery_set(run_block);            break;
-    case 'r': battery_set(run_rabbit);           break;
-    case 's': battery_set(run_smallcrush);       break;
-    case 'c': battery_set(run_crush);            break;
-    case 'p': data.inc     = 0x9e3779b97f4a7c15; break;
-    case '?': help_options(argv[0]);             break;
-      
-    default:
-      printf("internal error: what option? %c (%u)\n", c,c);
     }
+
+    free(sum);
   }
 
-  if (optind == argc) return;
+  for(uint32_t j=0; j<nd; j++)
+    diff_stat(r+j, total+j, (double)nblocks*DIFF_BLOCK);
 
-  // get filename and silently ignore anything past it
-  filename     = argv[optind];
-  battery_bits = (double)get_file_size(filename) * 8.0;
+  free(total);
+}
 
-  if (battery_bits < 4096.0) {
-    printf("error: datafile too small\n");
+void diff_run(void)
+{
+  diff_stat_t* r = malloc(delta_count*sizeof(diff_stat_t));
+
+  if (!r) {
+    fprintf(stderr, FAIL "error:" ENDC " allocation failed\n");
     exit(-1);
   }
-}
 
-void pre_trial(void)
-{
-  if (!testu01out) dup2(null_stdout, STDOUT_FILENO);
+  printf("diff:    %u deltas, %u inputs\n\n", delta_count,
+	 (diff_samples + DIFF_BLOCK-1)/DIFF_BLOCK*DIFF_BLOCK);
+
+  diff_measure(r);
+
+  char* div = table.style->div;
+
+  mini_report_table_init(&table, 6, "        delta         ","   bias   "," max bias ",
+			 "  weight p  ","byte p (min)","  zero  ");
+
+  mini_report_table_header(stdout, &table);
+
+  for(uint32_t j=0; j<delta_count; j++) {
+    printf("%s %-*.*s%s%*.3f%s%*.6f%s",
+	   div, table.col[0].width-1, table.col[0].width-1, deltas[j].name,
+	   div, table.col[1].width,   r[j].bias,
+	   div, table.col[2].width,   r[j].peak,
+	   div);
+
+    print_pvalue(stdout, r[j].weight_p);
+    printf("%s", div);
+    print_pvalue(stdout, r[j].byte_p);
+    printf("%s%*lu%s\n", div, table.col[5].width, r[j].zero, div);
+  }
+
+  mini_report_table_end(stdout, &table);
+
+  free(r);
 }
 
-void post_trial(void)
+// internal source: runs the remaining trials
+void run_trials(void)
 {
-  dup2(real_stdout, STDOUT_FILENO);
-  if (!testu01out) report();
+  switch(battery) {
+  case run_rabbit:
+    for(; trial_num<trials; trial_num++) {
+      pre_trial();
+      bbattery_Rabbit(gen, battery_bits);
+      post_trial();
+    }
+    break;
+
+  case run_alphabit:
+    for(; trial_num<trials; trial_num++) {
+      pre_trial();
+      bbattery_Alphabit(gen, battery_bits, 0, 32);
+      post_trial();
+    }
+    break;
+
+  case run_block:
+    for(; trial_num<trials; trial_num++) {
+      pre_trial();
+      bbattery_BlockAlphabit(gen, battery_bits, 0, 32);
+      post_trial();
+    }
+    break;
+
+  case run_smallcrush:
+    for(; trial_num<trials; trial_num++) {
+      pre_trial();
+      bbattery_SmallCrush(gen);
+      post_trial();
+    }
+    break;
+
+  case run_crush:
+    for(; trial_num<trials; trial_num++) {
+      pre_trial();
+      bbattery_Crush(gen);
+      post_trial();
+    }
+    break;
+
+  default:
+    printf("internal error: what battery??\n");
+    exit(-1);
+    break;
+  }
 }
 
 int main(int argc, char** argv)
@@ -871,6 +3011,128 @@ int main(int argc, char** argv)
 
   parse_options(argc, argv);
 
+  counter_initial = data.counter;
+
+  for (uint32_t i=0; i<LENGTHOF(total_peak); i++) {
+    total_peak[i] = 1.0;
+  }
+
+  if (tournament_enabled) {
+    if (tournament_file) tournament_load();
+    if (!tournament_file && !compare_list) compare_list = "all";
+  }
+
+  if (diff_enabled) {
+    // a generator only plugin has no finalizer to differentiate
+    bool no_f = plugin && !plugin->f && bit_finalizer_type == hash_type_plugin;
+
+    if (compare_list || tournament_enabled || stages_enabled || filename || bit_finalizer_32 || no_f) {
+      fprintf(stderr, FAIL "error:" ENDC " --diff is for a single internal 64-bit finalizer\n");
+      exit(-1);
+    }
+
+    delta_setup();
+
+    printf("source:  %s\n", bit_finalizer_name);
+    printf("counter: 0x%016lx\n", counter_initial);
+    printf("inc:     0x%016lx\n", data.inc);
+
+    diff_run();
+
+    return 0;
+  }
+
+  if (delta_list) delta_setup();
+
+  if (stages_enabled && (compare_list || tournament_enabled)) {
+    fprintf(stderr, FAIL "error:" ENDC " --stages is for a single finalizer (not --hash lists/--tournament)\n");
+    exit(-1);
+  }
+
+  if (compare_list || tournament_enabled || stages_enabled) {
+    if (filename || bit_finalizer_32 || demand_enabled || perf_enabled || progress_enabled ||
+	checkpoint_filename || resume_filename) {
+      fprintf(stderr, FAIL "error:" ENDC " comparison is internal 64-bit only and doesn't support "
+	      "--demand/--perf/--progress/--checkpoint/--resume\n");
+      exit(-1);
+    }
+    if (compare_list)   compare_build();
+    if (stages_enabled) stages_build();
+
+    if (compare_count == 0) {
+      fprintf(stderr, FAIL "error:" ENDC " no candidates\n");
+      exit(-1);
+    }
+  }
+
+  select_generator();
+
+  if (demand_enabled) {
+    if (filename) {
+      fprintf(stderr, FAIL "error:" ENDC " --demand requires an internal source\n");
+      exit(-1);
+    }
+    trials     = 1;
+    demand_gen = gen;
+    gen        = &gen_demand;
+  }
+
+  if (perf_enabled) {
+    if (perf_counters_open() && !filename) {
+      refill_base = refill;
+      refill      = refill_perf;
+    }
+    else {
+      fprintf(stderr, WARNING "warning" ENDC ": --perf ignored. no counters available or file source\n");
+      perf_enabled = false;
+    }
+  }
+
+  if (second_enabled && (filename || !second_init())) {
+    fprintf(stderr, WARNING "warning" ENDC ": --second ignored. file source\n");
+    second_enabled = false;
+  }
+
+  if (checkpoint_filename || resume_filename || cache_enabled) {
+    if (filename) {
+      fprintf(stderr, WARNING "warning" ENDC ": --checkpoint/--resume/--cache ignored. file source\n");
+      checkpoint_filename = resume_filename = NULL;
+      cache_enabled = false;
+    }
+    else if (demand_enabled || perf_enabled) {
+      fprintf(stderr, FAIL "error:" ENDC " --checkpoint/--resume/--cache don't support --demand/--perf\n");
+      exit(-1);
+    }
+    else if (cache_enabled && (checkpoint_filename || resume_filename)) {
+      fprintf(stderr, FAIL "error:" ENDC " --cache keeps its own checkpoint (not with --checkpoint/--resume)\n");
+      exit(-1);
+    }
+    else if (resume_filename)
+      checkpoint_resume();
+    else if (cache_enabled && compare_count == 0)
+      cache_open();
+  }
+
+  if (plog_filename) {
+    if (filename)
+      fprintf(stderr, WARNING "warning" ENDC ": --log ignored. file source\n");
+    else
+      plog_open();
+  }
+
+  if (progress_enabled) {
+    if (filename) {
+      fprintf(stderr, WARNING "warning" ENDC ": --progress ignored. file source\n");
+      progress_enabled = false;
+    }
+    else if (progress_expect)
+      progress_demand  = demand_table_value(progress_expect, "words");
+    else if (battery == run_alphabit || battery == run_block)
+      progress_demand  = (uint64_t)(battery_bits/32.0);
+
+    progress_measure = (progress_demand == 0);
+  }
+
   // hack-horrific to prevent default TestU01 reporting
   real_stdout = dup(STDOUT_FILENO);
   null_stdout = open("/dev/null", O_WRONLY);
@@ -882,21 +3144,48 @@ int main(int argc, char** argv)
 
   // spew some info about the tests we're performing
   printf("battery: " BOLD "%s" ENDC "\n", battery_info[battery].name);
-  printf("source:  ");
 
-  for (uint32_t i=0; i<LENGTHOF(total_peak); i++) {
-    total_peak[i] = 1.0;
+  if (compare_count) {
+    printf("counter: 0x%016lx\n", counter_initial);
+    printf("inc:     0x%016lx\n", data.inc);
+    if (delta_source) printf("delta:   %s\n", delta_source->name);
+    printf("sample:  %s\n", sample_info[sample].name);
+    printf("trials:  %u\n", trials);
+
+    if (tournament_enabled)
+      tournament_run();
+    else if (stages_enabled)
+      stages_run();
+    else
+      compare_run();
+
+    return 0;
   }
-  
+
+  printf("source:  ");
+
   if (filename) {
     printf("%s : %.0f bits\n", filename, battery_bits);
   }
   else {
-    printf("%s\n",   bit_finalizer_name);
-    printf("counter: 0x%016lx\n", data.counter);
+    printf("%s%s\n", bit_finalizer_name, prng_plugin_enabled ? " (plugin generator)" : "");
+    printf("counter: 0x%016lx\n", counter_initial);
     printf("inc:     0x%016lx\n", data.inc);
-    printf("sample:  %s\n", sample_info[0].name);
+    if (delta_source) printf("delta:   %s\n", delta_source->name);
+    printf("sample:  %s\n", sample_info[sample].name);
     printf("trials:  %u\n", trials);
+
+    if (resume_filename)
+      printf("resume:  %s at trial %u\n", resume_filename, trial_first);
+
+    if (cache_enabled)
+      printf("cache:   %s (%u trials)\n", checkpoint_filename, cache_hit ? checkpoint_trials : 0);
+
+    if (bit_finalizer_32) {
+      printf("period:  2^%.0f\n", log2(period_32()));
+      if (battery == run_alphabit || battery == run_block || battery == run_rabbit)
+	printf("size:    2^%.2f outputs per trial\n", log2(battery_bits/32.0));
+    }
   }
   
   // file based or internal computation  
@@ -909,8 +3198,10 @@ int main(int argc, char** argv)
     case run_block:      bbattery_BlockAlphabitFile(filename, battery_bits); break;
 
     case run_rabbit:
-      battery_bits = 0.25*battery_bits;
-      fprintf(stderr, WARNING "warning" ENDC ": halving size because rabbit uses more than specified and barfs\n");
+      if (!battery_bits_set) {
+	battery_bits = 0.25*battery_bits;
+	fprintf(stderr, WARNING "warning" ENDC ": halving size because rabbit uses more than specified and barfs\n");
+      }
       bbattery_RabbitFile(filename,   battery_bits);
       break;
 
@@ -933,52 +3224,16 @@ int main(int argc, char** argv)
     if (!testu01out) report();
   }
   else {
-    switch(battery) {
-    case run_rabbit:
-      for(; trial_num<trials; trial_num++) {
-	pre_trial();
-	bbattery_Rabbit(gen, battery_bits);
-	post_trial();
-      }
-      break;
-      
-    case run_alphabit:
-      for(; trial_num<trials; trial_num++) {
-	pre_trial();
-	bbattery_Alphabit(gen, battery_bits, 0, 32);
-	post_trial();
-      }
-      break;
-      
-    case run_block:
-      for(; trial_num<trials; trial_num++) {
-	pre_trial();
-	bbattery_BlockAlphabit(gen, battery_bits, 0, 32);
-	post_trial();
-      }
-      break;
-      
-    case run_smallcrush:
-      for(; trial_num<trials; trial_num++) {
-	pre_trial();
-	bbattery_SmallCrush(gen);
-	post_trial();
-      }
-      break;
-      
-    case run_crush:
-      for(; trial_num<trials; trial_num++) {
-	pre_trial();
-	bbattery_Crush(gen);
-	post_trial();
-      }
-      break;
+    if (cache_hit) cache_replay();
 
-    default:
-      printf("internal error: what battery??\n");
-      exit(-1);
-      break;
+    if (progress_enabled && !progress_begin()) {
+      fprintf(stderr, WARNING "warning" ENDC ": --progress ignored. couldn't create thread\n");
+      progress_enabled = false;
     }
+
+    run_trials();
+
+    if (progress_enabled) progress_end();
   }
 
   // local multi trial summary information is gathered at per-trial reporting time.
@@ -995,11 +3250,19 @@ int main(int argc, char** argv)
       printf("  statistics:   %10u\n", statistic_count);
       printf("    suspicious: %10u\n", suspicious_count);
       printf("    failed:     %10u\n", failure_count);
-      
-      if (trials > 1) {
-	report_final();
-      }
     }
+
+    if ((trials > 1 && (suspicious_count+failure_count) != 0) || perf_enabled)
+      report_final();
+
+    if (perf_enabled)
+      report_perf();
+
+    if (demand_enabled)
+      report_demand();
+
+    if (second_enabled)
+      report_second();
   }
   
   return 0;
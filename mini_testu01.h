@@ -1,5 +1,7 @@
 //*****************************************************************************
 
+#include <stdbool.h>
+
 // compile time constants for: LCG & PCG generators
 static const uint64_t prng_mul_k = UINT64_C(0xd1342543de82ef95);
 static const uint64_t prng_add_k = UINT64_C(0x2545f4914f6cdd1d);
@@ -25,6 +27,16 @@ static const uint64_t prng_add_k = UINT64_C(0x2545f4914f6cdd1d);
 #define hint_unroll(X)
 #endif
 
+// hot kernels: for a portable build (ARCH in the Makefile) also compiled
+// for x86-64-v3 (AVX2) and v4 (AVX-512) with the best picked once at
+// startup by CPUID (ifunc). nothing to pick when the target has AVX-512.
+// GCC only: clang builds get the baseline kernel.
+#if defined(__x86_64__) && !defined(__AVX512F__) && defined(__GNUC__) && !defined(__clang__)
+#define hot_kernel __attribute__((target_clones("default","arch=x86-64-v3","arch=x86-64-v4")))
+#else
+#define hot_kernel
+#endif
+
 // this is a questionable def but shouldn't break anything
 #if defined(__GNUC__)
 #define hint_result_barrier(X) __asm__ volatile("" : "+r"(X) : "r"(X));
@@ -53,6 +65,14 @@ extern void print_warning(char* msg);
 
 
 typedef uint64_t (hash_t)(uint64_t);
+typedef uint32_t (hash32_t)(uint32_t);
+
+// hash 'n' values of 's' into 'd' (can be the same array)
+typedef void (hash_batch_t)(uint64_t* d, const uint64_t* s, size_t n);
+
+// 32-bit: hash the low 32 bits of 'n' values of 's' into 'd' (zero
+// extended, can be the same array)
+typedef void (hash32_batch_t)(uint64_t* d, const uint64_t* s, size_t n);
 
 //*****************************************************************************
 
@@ -60,14 +80,23 @@ enum {
   hash_type_default,      // unknown compiled in
   hash_type_xsm3,         // murmur3 style 2 xorshift/multiply/xorshift
   hash_type_builtin,      // named builtin
+  hash_type_xsm3_32,      // 32-bit xorshift/multiply
+  hash_type_jit,          // compiled & loaded at runtime (--jit)
+  hash_type_plugin,       // external shared object (--plugin)
+  hash_type_compose,      // interpreted stage list (--compose)
 };
 
 // active function
 //hash_t*   bit_finalizer      = hash;  // temp hack
-extern hash_t*   bit_finalizer;
-extern char*     bit_finalizer_name;
-extern uint32_t  bit_finalizer_type;
-extern uint32_t  bit_finalizer_id;
+extern hash_t*       bit_finalizer;
+extern hash_batch_t* bit_finalizer_batch;
+extern hash32_t*     bit_finalizer_32;      // NULL unless a 32-bit was selected last
+extern hash32_batch_t* bit_finalizer_32_batch;
+extern char*         bit_finalizer_name;
+extern uint32_t      bit_finalizer_type;
+extern uint32_t      bit_finalizer_id;
+
+extern void hash_batch_generic(uint64_t* d, const uint64_t* s, size_t n);
 
 //*****************************************************************************
 // hardcoded and general 3 stage xorshift/multiply finalizers
@@ -78,26 +107,176 @@ typedef struct {
   uint8_t  s0,s1,s2;
   char*    name;
   hash_t*  f;
+  hash_batch_t* b;
 } xorshift_mul_3_t;
 
 extern xorshift_mul_3_t xorshift_mul_3_gen;
 
-// dump c code to stdout
+// dump c code to stdout (or 'file')
 extern void pretty_print_xorshift_mul_3(const xorshift_mul_3_t* def, uint32_t indent);
+extern void fpretty_print_xorshift_mul_3(FILE* file, const xorshift_mul_3_t* def, uint32_t indent);
 
 // list hardcoded parameter versions
 extern const xorshift_mul_3_t* xorshift_mul_3_current;
+extern const xorshift_mul_3_t  xorshift_mul_3_def[];
+extern const uint32_t          xorshift_mul_3_def_len;
+
+// "s0,m0,s1,m1,s2" -> def. false if malformed
+extern bool parse_xorshift_mul_3(char* str, xorshift_mul_3_t* def);
+extern void set_xorshift_mul_3_gen(const xorshift_mul_3_t* def);
+extern uint64_t fxsm3_gen(uint64_t x);
+extern void fxsm3_gen_batch(uint64_t* d, const uint64_t* s, size_t n);
 
 extern void print_xorshift_mul_3(void);
 extern hash_t* get_xorshift_mul_3(char* name);
 
 
+//*****************************************************************************
+// 32-bit versions
+
+typedef struct {
+  uint32_t  m0,m1;
+  uint8_t   s0,s1,s2;
+  char*     name;
+  hash32_t* f;
+  hash32_batch_t* b;
+} xorshift_mul_3_32_t;
+
+extern xorshift_mul_3_32_t        xorshift_mul_3_32_gen;
+extern const xorshift_mul_3_32_t* xorshift_mul_3_32_current;
+extern const xorshift_mul_3_32_t  xorshift_mul_3_32_def[];
+extern const uint32_t             xorshift_mul_3_32_def_len;
+
+extern uint32_t xorshift_mul_3_32(uint32_t x);
+extern void     xorshift_mul_3_32_batch(uint64_t* d, const uint64_t* s, size_t n);
+extern uint8_t  xorshift_mul_3_scale_shift(uint32_t s, uint32_t bits);
+extern void     xorshift_mul_3_to_32(xorshift_mul_3_32_t* d, const xorshift_mul_3_t* s);
+
+extern void pretty_print_xorshift_mul_3_32(const xorshift_mul_3_32_t* def, uint32_t indent);
+extern void print_xorshift_mul_3_32(void);
+
+extern hash32_t* get_hash32(char* name);
+
 //*****************************************************************************
 // more duct-tape and glue!
 
 static inline uint64_t wyhash(uint64_t x);
 
+// one-off named functions (not 'xorshift_mul_3_t' expressible)
+typedef struct {
+  char*         name;
+  hash_t*       f;
+  hash_batch_t* b;
+} hash_builtin_t;
+
+extern const hash_builtin_t hash_builtin_def[];
+extern const uint32_t       hash_builtin_def_len;
+
 extern hash_t* get_hash(char* name);
+
+// build/load a finalizer from source (see common.c). NULL on failure
+extern hash_t* jit_hash(char* spec);
+
+// select a composition of stages (see common.c). NULL on failure
+extern hash_t* compose_hash(char* spec);
+
+#define COMPOSE_MAX_OPS 64
+
+// of the current composition: run ops [first,end), the round ends and
+// the canonical spec of ops [first,end)
+extern uint32_t compose_len;
+extern void     compose_run(uint64_t* d, const uint64_t* s, size_t n, uint32_t first, uint32_t end);
+extern uint32_t compose_rounds(uint32_t* end);
+extern void     compose_spec(char* buf, size_t len, uint32_t first, uint32_t end);
+
+// avalanche accumulator (exhaustive, search, --stages): flip counts of
+// output bit 'j' for flips of input bit 'i' over 'n' inputs. bias is
+// total/n - 1/2
+typedef struct {
+  uint64_t total[64][64];               // [input bit][output bit]
+  uint64_t lane[64][8];                 // byte lanes (not yet in total)
+  uint32_t pending[64];                 // differences in the lanes
+} sac_acc_t;
+
+extern void sac_acc_clear(sac_acc_t* a);
+
+// 'n' output differences of flipping input bit 'b'
+extern void sac_acc_add(sac_acc_t* a, uint32_t b, const uint64_t* d, size_t n);
+
+// one input: d[b] is the difference of flipping bit 'b' on [0,bits).
+// the output is also 'bits' wide
+extern void sac_acc_row(sac_acc_t* a, const uint64_t* d, uint32_t bits);
+
+// moves the lanes into 'total'
+extern void sac_acc_flush(sac_acc_t* a);
+
+// d->total += s->total (flushes 's')
+extern void sac_acc_merge(sac_acc_t* d, sac_acc_t* s);
+
+// 4N*mean(bias^2) over the bits x bits matrix (~1 is random) and the max
+// |bias| in 'peak' (if not NULL)
+extern double sac_acc_fitness(sac_acc_t* a, uint32_t bits, uint64_t n, double* peak);
+
+// differential input relation: x -> (x + add) ^ mask
+typedef struct {
+  uint64_t add;
+  uint64_t mask;
+  char*    name;                        // as given
+} delta_t;
+
+#define DELTA_MAX 4096
+
+// "VALUE,^VALUE,inc,K*inc,..." (see common.c) -> up to 'max' deltas.
+// returns the count, 0 on failure
+extern uint32_t parse_delta_list(char* list, uint64_t inc, delta_t* d, uint32_t max);
+
+// load a plugin (see plugin.h) and select its finalizer (if any). NULL
+// on failure
+#include "plugin.h"
+
+extern const mtu_plugin_t* plugin;
+extern const mtu_plugin_t* plugin_load(char* path);
 extern void bit_finalizer_pretty_print(void);
 
+// FNV-1a of 'n' bytes continuing from 'h' (FNV_64_INIT to start)
+#define FNV_64_INIT UINT64_C(0xcbf29ce484222325)
+extern uint64_t fnv_64(const void* data, size_t n, uint64_t h);
+
 extern uint64_t get_timestamp(void);
+extern uint64_t demand_table_value(char* filename, char* key);
+
+//*****************************************************************************
+// hardware performance counters (Linux only, otherwise open fails)
+
+enum {
+  perf_cycles,
+  perf_instructions,
+  perf_branch_miss,
+  perf_cache_miss,
+  perf_counter_length
+};
+
+typedef struct { uint64_t v[perf_counter_length]; } perf_counts_t;
+
+extern bool  perf_counter_valid[perf_counter_length];
+extern char* perf_counter_name[perf_counter_length];
+
+extern bool perf_counters_open(void);
+extern void perf_counters_read(perf_counts_t* c);
+extern void perf_counts_accum(perf_counts_t* a, const perf_counts_t* e, const perf_counts_t* s);
+
+//*****************************************************************************
+// p-value log (mini_testu01 --log, read by plog): a sequence of blocks one
+// per trial, each written with a single append. Statistic 'i' of a block
+// is the i-th p-value (the battery's order). The configuration id is the
+// same hash that names --cache entries.
+
+#define PLOG_MAGIC 0x676c706d   // "mplg"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t count;               // number of p-values that follow
+  uint64_t config;              // configuration id
+  uint32_t trial;
+  uint32_t battery;             // mini_testu01 battery id
+} plog_block_t;                 // followed by 'count' doubles
@@ -0,0 +1,326 @@
+// Marc B. Reynolds, 2022-2025
+// Public Domain under http://unlicense.org, see link for details.
+
+// Reader for the binary p-value log written by mini_testu01 --log=FILE.
+// The log is mmapped and walked once so aggregating millions of rows
+// is I/O bound. Per (battery, statistic) reports the number of rows,
+// the worst t = min(p,1-p) and the suspicious/failed counts. Statistic
+// ids are indices into the battery (mini_testu01 prints the names).
+// Optionally restricted to a single configuration id or summarized per
+// configuration.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mini_testu01.h"
+
+//*****************************************************************************
+
+#define PLOG_MAX_BATTERY 8
+#define PLOG_MAX_STAT    201
+
+// matches the mini_testu01 battery ids
+static char* battery_name[] = {
+  "Alphabit", "Block Alphabit", "Rabbit", "SmallCrush", "Crush"
+};
+
+typedef struct {
+  uint64_t rows;
+  uint64_t suspicious;
+  uint64_t failed;
+  double   worst;               // min(p,1-p)
+} plog_stat_t;
+
+typedef struct {
+  uint64_t config;
+  uint32_t battery;
+  uint32_t trials;
+  uint64_t rows;
+  uint64_t suspicious;
+  uint64_t failed;
+  double   worst;
+} plog_config_t;
+
+plog_stat_t    stats[PLOG_MAX_BATTERY][PLOG_MAX_STAT];
+plog_config_t* config_table = NULL;    // open addressing on 'config'
+uint32_t       config_size  = 0;       // power of two
+uint32_t       config_count = 0;
+
+double   pvalue_suspect = 0.001;
+double   pvalue_fail    = 0x1.0p-40;
+bool     show_all       = false;
+bool     by_config      = false;
+bool     filter         = false;
+uint64_t filter_config  = 0;
+
+static void config_grow(void);
+
+static plog_config_t* config_get(uint64_t id)
+{
+  if (2*(config_count+1) > config_size) config_grow();
+
+  uint32_t m = config_size-1;
+  uint32_t i = (uint32_t)(id ^ (id >> 32)) & m;
+
+  // zero id isn't expected (hashed) so is the empty marker
+  while (config_table[i].config != 0 && config_table[i].config != id)
+    i = (i+1) & m;
+
+  if (config_table[i].config == 0) {
+    config_table[i].config = id;
+    config_table[i].worst  = 1.0;
+    config_count++;
+  }
+
+  return config_table+i;
+}
+
+static void config_grow(void)
+{
+  plog_config_t* old  = config_table;
+  uint32_t       size = config_size;
+
+  config_size  = size ? 2*size : 1024;
+  config_table = calloc(config_size, sizeof(plog_config_t));
+  config_count = 0;
+
+  if (!config_table) {
+    fprintf(stderr, "error: allocation failed\n");
+    exit(-1);
+  }
+
+  for(uint32_t i=0; i<size; i++) {
+    if (old[i].config == 0) continue;
+    *config_get(old[i].config) = old[i];
+  }
+
+  free(old);
+}
+
+static int config_cmp(const void* a, const void* b)
+{
+  const plog_config_t* x = a;
+  const plog_config_t* y = b;
+
+  if (x->failed     != y->failed)     return (x->failed     > y->failed)     ? -1 : 1;
+  if (x->suspicious != y->suspicious) return (x->suspicious > y->suspicious) ? -1 : 1;
+  if (x->worst      != y->worst)      return (x->worst      < y->worst)      ? -1 : 1;
+
+  return 0;
+}
+
+//*****************************************************************************
+
+static uint64_t plog_scan(const uint8_t* p, size_t len)
+{
+  const uint8_t* end  = p+len;
+  uint64_t       rows = 0;
+
+  while ((size_t)(end-p) >= sizeof(plog_block_t)) {
+    plog_block_t b;
+
+    memcpy(&b, p, sizeof(b));
+
+    size_t size = sizeof(b) + (size_t)b.count*sizeof(double);
+
+    if (b.magic != PLOG_MAGIC || (size_t)(end-p) < size) {
+      fprintf(stderr, "warning: bad or truncated block at offset %zu. stopping\n", len-(size_t)(end-p));
+      break;
+    }
+
+    const uint8_t* v = p + sizeof(b);
+
+    p += size;
+
+    if (filter && b.config != filter_config) continue;
+
+    if (b.battery >= PLOG_MAX_BATTERY) continue;
+
+    plog_stat_t*   s = stats[b.battery];
+    plog_config_t* c = by_config ? config_get(b.config) : NULL;
+    uint32_t       n = (b.count < PLOG_MAX_STAT) ? b.count : PLOG_MAX_STAT;
+    uint32_t       w = 0, f = 0;
+    double         m = 1.0;
+
+    for(uint32_t i=0; i<n; i++) {
+      double pv;
+      memcpy(&pv, v+i*sizeof(double), sizeof(double));
+
+      double t = fmin(pv, 1.0-pv);
+
+      s[i].rows++;
+      s[i].worst = fmin(s[i].worst, t);
+      m          = fmin(m, t);
+
+      if (t <= pvalue_suspect) {
+	if (t > pvalue_fail) { s[i].suspicious++; w++; }
+	else                 { s[i].failed++;     f++; }
+      }
+    }
+
+    rows += n;
+
+    if (c) {
+      c->battery     = b.battery;
+      c->trials     += 1;
+      c->rows       += n;
+      c->suspicious += w;
+      c->failed     += f;
+      c->worst       = fmin(c->worst, m);
+    }
+  }
+
+  return rows;
+}
+
+static void report_stats(void)
+{
+  printf("%-14s %5s %12s %12s %10s %10s\n", "battery", "stat", "rows", "worst t", "suspicious", "failed");
+
+  for(uint32_t b=0; b<PLOG_MAX_BATTERY; b++) {
+    for(uint32_t i=0; i<PLOG_MAX_STAT; i++) {
+      plog_stat_t* s = &stats[b][i];
+
+      if (s->rows == 0) continue;
+      if (!show_all && (s->suspicious+s->failed) == 0) continue;
+
+      printf("%-14s %5u %12lu %12.4e %10lu %10lu\n",
+	     (b < LENGTHOF(battery_name)) ? battery_name[b] : "?",
+	     i, s->rows, s->worst, s->suspicious, s->failed);
+    }
+  }
+}
+
+static void report_configs(void)
+{
+  plog_config_t* list = malloc((config_count ? config_count : 1)*sizeof(plog_config_t));
+  uint32_t       n    = 0;
+
+  if (!list) return;
+
+  for(uint32_t i=0; i<config_size; i++)
+    if (config_table[i].config != 0) list[n++] = config_table[i];
+
+  qsort(list, n, sizeof(plog_config_t), config_cmp);
+
+  printf("\n%-16s  %-14s %7s %12s %12s %10s %10s\n", "config", "battery", "trials", "rows", "worst t", "suspicious", "failed");
+
+  for(uint32_t i=0; i<n; i++) {
+    plog_config_t* c = list+i;
+
+    printf("%016lx  %-14s %7u %12lu %12.4e %10lu %10lu\n",
+	   c->config,
+	   (c->battery < LENGTHOF(battery_name)) ? battery_name[c->battery] : "?",
+	   c->trials, c->rows, c->worst, c->suspicious, c->failed);
+  }
+
+  free(list);
+}
+
+//*****************************************************************************
+
+void help_options(char* name)
+{
+  printf("Usage: %s [OPTIONS] FILE\n", name);
+  printf("\n"
+	 "    --psus=VALUE     suspicious threshold (default = 0.001)\n"
+	 "    --pfail=VALUE    failure threshold    (default = 2^(-40))\n"
+	 "    --config=ID      only rows of configuration ID (hex)\n"
+	 "    --configs        summary per configuration\n"
+	 "    --all            show all statistics (default only those flagged)\n"
+	 "    --help           \n"
+	 "\n");
+
+  exit(0);
+}
+
+int main(int argc, char** argv)
+{
+  static struct option long_options[] = {
+    {"psus",       required_argument, 0, 's'},
+    {"pfail",      required_argument, 0, 'f'},
+    {"config",     required_argument, 0, 'c'},
+    {"configs",    no_argument,       0, 'C'},
+    {"all",        no_argument,       0, 'a'},
+    {"help",       optional_argument, 0, '?'},
+    {0,            0,                 0,  0 }
+  };
+
+  int c;
+
+  while (1) {
+    int option_index = 0;
+
+    c = getopt_long(argc, argv, "", long_options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 's': pvalue_suspect = strtod(optarg, NULL); break;
+    case 'f': pvalue_fail    = strtod(optarg, NULL); break;
+    case 'c': filter = true; filter_config = strtoul(optarg, NULL, 16); break;
+    case 'C': by_config = true; break;
+    case 'a': show_all  = true; break;
+    case '?': help_options(argv[0]); break;
+
+    default:
+      printf("internal error: what option? %c (%u)\n", c,c);
+    }
+  }
+
+  if (optind == argc) help_options(argv[0]);
+
+  char*       name = argv[optind];
+  int         fd   = open(name, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "error: couldn't open '%s'\n", name);
+    return -1;
+  }
+
+  for(uint32_t b=0; b<PLOG_MAX_BATTERY; b++)
+    for(uint32_t i=0; i<PLOG_MAX_STAT; i++)
+      stats[b][i].worst = 1.0;
+
+  if (st.st_size == 0) {
+    printf("empty log\n");
+    return 0;
+  }
+
+  size_t len = (size_t)st.st_size;
+  void*  map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "error: couldn't map '%s'\n", name);
+    return -1;
+  }
+
+  madvise(map, len, MADV_SEQUENTIAL);
+
+  uint64_t t0   = get_timestamp();
+  uint64_t rows = plog_scan(map, len);
+  uint64_t t1   = get_timestamp();
+
+  printf("%s: %lu rows (%.3f s)\n\n", name, rows, 1e-9*(double)(t1-t0));
+
+  report_stats();
+
+  if (by_config) report_configs();
+
+  munmap(map, len);
+  close(fd);
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+// Marc B. Reynolds, 2022-2025
+// Public Domain under http://unlicense.org, see link for details.
+
+// Plugin interface (--plugin=PATH): externally built finalizers and
+// generators tested by the unmodified binaries. Standalone so a plugin
+// only needs this header. A shared object exports one 'mtu_plugin':
+//
+//   #include "plugin.h"
+//
+//   static uint64_t my_hash(uint64_t x) { ... }
+//
+//   const mtu_plugin_t mtu_plugin = {
+//     .abi  = MTU_PLUGIN_ABI,
+//     .name = "my_hash",
+//     .f    = my_hash,
+//   };
+//
+//   cc -O3 -march=native -fPIC -shared my_hash.c -o my_hash.so
+//
+// Entry points:
+//   f:     the finalizer. required unless 'next' is provided.
+//   b:     optional batch 'f'. hashes 'n' values of 's' into 'd' (can be
+//          the same array). without it each value is a call of 'f'.
+//   next:  optional state based generator. fills 'd' with the next 'n'
+//          outputs. 'seed' is called once per run (with the initial
+//          counter) on 'state_size' bytes of zeroed state (64 byte
+//          aligned). when present it's the source instead of hashing
+//          the counter sequence.
+
+#ifndef MTU_PLUGIN_H
+#define MTU_PLUGIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// bumped on incompatible changes. plugins built against another are rejected
+#define MTU_PLUGIN_ABI 1
+
+typedef struct {
+  uint32_t    abi;
+  const char* name;
+  uint64_t  (*f)(uint64_t x);
+  void      (*b)(uint64_t* d, const uint64_t* s, size_t n);
+  size_t      state_size;
+  void      (*seed)(void* state, uint64_t seed);
+  void      (*next)(void* state, uint64_t* d, size_t n);
+} mtu_plugin_t;
+
+#endif
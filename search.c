@@ -0,0 +1,434 @@
+// Marc B. Reynolds, 2022-2025
+// Public Domain under http://unlicense.org, see link for details.
+
+// Search for 3 stage xorshift/multiply parameters (s0,m0,s1,m1,s2).
+//
+// Independent simulated annealing runs (random restarts) in parallel
+// score candidates with a sampled 64-bit avalanche fitness: for N inputs
+// each input bit is flipped and the flip count of every output bit is
+// accumulated. The fitness is the mean squared bias scaled by 4N so
+// a value near one is indistinguishable from a random function at
+// that sample size. Half of the inputs are a counter (how they're fed
+// in mini_testu01) and half random. Each run anneals with a fixed input
+// set so the winners are re-scored with a larger independent one before
+// ranking (limits selecting noise).
+//
+// The top-K are printed as code and written one per line (the format
+// mini_testu01 --tournament reads) which is how they're validated with
+// the TestU01 batteries (--validate runs it).
+//
+// Avalanche is a necessary, not sufficient, property. Treat the output
+// as candidates.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include "mini_testu01.h"
+
+//*****************************************************************************
+
+static inline uint64_t search_rand(uint64_t* s)
+{
+  uint64_t x = (*s += UINT64_C(0x9e3779b97f4a7c15));
+
+  x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+  return x ^ (x >> 31);
+}
+
+static inline uint32_t search_range(uint64_t* s, uint32_t n)
+{
+  return (uint32_t)(((search_rand(s) >> 32)*n) >> 32);
+}
+
+static inline double search_f64(uint64_t* s)
+{
+  return (double)(search_rand(s) >> 11)*0x1.0p-53;
+}
+
+//*****************************************************************************
+// sampled avalanche (sac_acc_t in common.c)
+
+typedef struct {
+  double fitness;     // 4N * mean(bias^2). ~1 is random
+  double peak;        // max |bias|
+} fitness_t;
+
+static inline uint64_t xsm3(uint64_t x, const xorshift_mul_3_t* p)
+{
+  uint64_t m0 = p->m0, m1 = p->m1;
+  uint32_t s0 = p->s0, s1 = p->s1, s2 = p->s2;
+
+  x = (x ^ (x >> s0)) * m0;
+  x = (x ^ (x >> s1)) * m1;
+  x = (x ^ (x >> s2));
+
+  return x;
+}
+
+// 'n' inputs from 'seed': first half a counter, second half random
+static void fitness_eval(fitness_t* f, const xorshift_mul_3_t* p, uint64_t seed, uint32_t n)
+{
+  sac_acc_t acc;
+  uint64_t  d[64];
+  uint64_t  c = seed;
+  uint64_t  r = seed;
+
+  sac_acc_clear(&acc);
+
+  for(uint32_t i=0; i<n; i++) {
+    uint64_t x = (i < n/2) ? c++ : search_rand(&r);
+    uint64_t h = xsm3(x, p);
+
+    for(uint32_t b=0; b<64; b++)
+      d[b] = h ^ xsm3(x ^ (UINT64_C(1) << b), p);
+
+    sac_acc_row(&acc, d, 64);
+  }
+
+  f->fitness = sac_acc_fitness(&acc, 64, n, &f->peak);
+}
+
+//*****************************************************************************
+// candidates & top-K
+
+#define SEARCH_MAX_TOP 64
+
+typedef struct {
+  xorshift_mul_3_t p;
+  fitness_t        f;           // search sample (then re-scored)
+} candidate_t;
+
+candidate_t top[SEARCH_MAX_TOP];
+uint32_t    top_len = 0;
+
+uint32_t    top_k       = 8;
+uint32_t    restarts    = 0;          // zero is 4 per thread
+uint32_t    steps       = 2000;       // annealing steps per restart
+uint32_t    samples     = 1u << 11;   // fitness inputs during search
+uint32_t    samples_fin = 1u << 15;   // re-scoring inputs
+uint32_t    shift_lo    = 16;
+uint32_t    shift_hi    = 48;
+uint64_t    seed        = 0;
+
+static bool same_params(const xorshift_mul_3_t* a, const xorshift_mul_3_t* b)
+{
+  return a->s0 == b->s0 && a->s1 == b->s1 && a->s2 == b->s2 && a->m0 == b->m0 && a->m1 == b->m1;
+}
+
+// keep the K lowest fitness (caller serializes)
+static void top_insert(const candidate_t* c)
+{
+  for(uint32_t i=0; i<top_len; i++)
+    if (same_params(&top[i].p, &c->p)) return;
+
+  uint32_t i = top_len;
+
+  if (i == top_k) {
+    if (c->f.fitness >= top[i-1].f.fitness) return;
+    i--;
+  }
+  else top_len++;
+
+  while (i > 0 && top[i-1].f.fitness > c->f.fitness) { top[i] = top[i-1]; i--; }
+
+  top[i] = *c;
+}
+
+static int candidate_cmp(const void* a, const void* b)
+{
+  double x = ((const candidate_t*)a)->f.fitness;
+  double y = ((const candidate_t*)b)->f.fitness;
+
+  return (x > y) - (x < y);
+}
+
+//*****************************************************************************
+// simulated annealing on log(fitness)
+
+static uint8_t random_shift(uint64_t* s)
+{
+  return (uint8_t)(shift_lo + search_range(s, shift_hi-shift_lo+1));
+}
+
+static void random_params(xorshift_mul_3_t* p, uint64_t* s)
+{
+  p->s0 = random_shift(s);
+  p->s1 = random_shift(s);
+  p->s2 = random_shift(s);
+  p->m0 = search_rand(s) | 1;
+  p->m1 = search_rand(s) | 1;
+}
+
+static void mutate(xorshift_mul_3_t* p, uint64_t* s)
+{
+  uint32_t  k = search_range(s, 8);
+  uint64_t* m = (search_rand(s) & 1) ? &p->m0 : &p->m1;
+  uint8_t*  t = (k == 0) ? &p->s0 : (k == 1) ? &p->s1 : &p->s2;
+
+  switch(k) {
+  case 0: case 1: case 2:
+    {
+      // small shift step kept in range
+      int32_t v = (int32_t)*t + ((search_rand(s) & 1) ? 1 : -1) * (int32_t)(1 + search_range(s, 2));
+      if (v < (int32_t)shift_lo) v = (int32_t)shift_lo;
+      if (v > (int32_t)shift_hi) v = (int32_t)shift_hi;
+      *t = (uint8_t)v;
+    }
+    break;
+
+  case 7:
+    // occasional fresh multiplier
+    *m = search_rand(s) | 1;
+    break;
+
+  default:
+    {
+      // flip 1-4 bits above bit zero (stays odd)
+      uint32_t n = 1 + search_range(s, 4);
+      for(uint32_t i=0; i<n; i++) *m ^= UINT64_C(1) << (1 + search_range(s, 63));
+    }
+  }
+}
+
+static void anneal(uint32_t run)
+{
+  uint64_t    s   = seed + UINT64_C(0x632be59bd9b4e019)*(run+1);
+  uint64_t    in  = search_rand(&s);      // fitness inputs of this run
+  candidate_t cur, best, next;
+  double      t0  = 0.5;
+  double      t1  = 0.002;
+
+  random_params(&cur.p, &s);
+  fitness_eval(&cur.f, &cur.p, in, samples);
+  best = cur;
+
+  for(uint32_t i=0; i<steps; i++) {
+    double temp = t0*pow(t1/t0, (double)i/(double)steps);
+
+    next = cur;
+    mutate(&next.p, &s);
+    fitness_eval(&next.f, &next.p, in, samples);
+
+    double d = log(next.f.fitness) - log(cur.f.fitness);
+
+    if (d <= 0.0 || search_f64(&s) < exp(-d/temp)) {
+      cur = next;
+      if (cur.f.fitness < best.f.fitness) best = cur;
+    }
+  }
+
+  #pragma omp critical
+  top_insert(&best);
+}
+
+//*****************************************************************************
+
+void help_options(char* name)
+{
+  printf("Usage: %s [OPTIONS]\n", name);
+  printf("\n"
+	 "  search:\n"
+	 "    --restarts=N     annealing runs (default 4 per thread)\n"
+	 "    --steps=N        steps per run (default 2000)\n"
+	 "    --samples=N      fitness inputs per step (default 2^11)\n"
+	 "    --final=N        re-scoring inputs (default 2^15)\n"
+	 "    --shifts=LO,HI   shift range (default 16,48)\n"
+	 "    --seed=VALUE     (default time based)\n"
+	 "  output:\n"
+	 "    --top=K          number kept (default 8, max 64)\n"
+	 "    --out=FILE       write the top-K (mini_testu01 --tournament format)\n"
+	 "    --validate[=ARG] run mini_testu01 --tournament on them (ARG is\n"
+	 "                     passed as is: say \"--trials=4 --jobs=8\")\n"
+	 "    --known          also score the built-in table for reference\n"
+	 "    --help           \n"
+	 "\n");
+
+  exit(0);
+}
+
+int main(int argc, char** argv)
+{
+  static struct option long_options[] = {
+    {"restarts",   required_argument, 0, 'r'},
+    {"steps",      required_argument, 0, 's'},
+    {"samples",    required_argument, 0, 'n'},
+    {"final",      required_argument, 0, 'f'},
+    {"shifts",     required_argument, 0, 'S'},
+    {"seed",       required_argument, 0, 'x'},
+    {"top",        required_argument, 0, 'k'},
+    {"out",        required_argument, 0, 'o'},
+    {"validate",   optional_argument, 0, 'v'},
+    {"known",      no_argument,       0, 'K'},
+    {"help",       optional_argument, 0, '?'},
+    {0,            0,                 0,  0 }
+  };
+
+  char* out      = NULL;
+  char* vargs    = "";
+  bool  validate = false;
+  bool  known    = false;
+  int   c;
+
+  seed = get_timestamp();
+
+  while (1) {
+    int option_index = 0;
+
+    c = getopt_long(argc, argv, "", long_options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 'r': restarts    = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 's': steps       = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 'n': samples     = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 'f': samples_fin = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 'x': seed        = strtoul(optarg, NULL, 0); break;
+    case 'k': top_k       = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 'o': out         = optarg; break;
+    case 'K': known       = true;   break;
+
+    case 'v':
+      validate = true;
+      if (optarg) vargs = optarg;
+      break;
+
+    case 'S':
+      if (sscanf(optarg, "%u,%u", &shift_lo, &shift_hi) != 2 || shift_lo < 1 || shift_hi > 63 || shift_lo > shift_hi) {
+	print_error("--shifts expects LO,HI on [1,63]");
+	return -1;
+      }
+      break;
+
+    case '?': help_options(argv[0]); break;
+
+    default:
+      printf("internal error: what option? %c (%u)\n", c,c);
+    }
+  }
+
+  if (top_k == 0)              top_k = 1;
+  if (top_k > SEARCH_MAX_TOP)  top_k = SEARCH_MAX_TOP;
+  if (samples < 64)            samples = 64;
+  if (samples_fin < 64)        samples_fin = 64;
+
+  int threads = 1;
+
+#if defined(_OPENMP)
+  threads = omp_get_max_threads();
+#endif
+
+  if (restarts == 0) restarts = 4*(uint32_t)threads;
+
+  printf("threads: %d, restarts: %u, steps: %u, samples: %u, final: %u, shifts: [%u,%u], seed: 0x%016lx\n\n",
+	 threads, restarts, steps, samples, samples_fin, shift_lo, shift_hi, seed);
+
+  uint64_t t0 = get_timestamp();
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for(uint32_t r=0; r<restarts; r++)
+    anneal(r);
+
+  uint64_t t1 = get_timestamp();
+
+  // re-score with a larger independent input set
+  uint64_t fin = seed ^ UINT64_C(0x5851f42d4c957f2d);
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for(uint32_t i=0; i<top_len; i++)
+    fitness_eval(&top[i].f, &top[i].p, fin, samples_fin);
+
+  qsort(top, top_len, sizeof(candidate_t), candidate_cmp);
+
+  printf("search: %.2f s (%.0f evaluations/s)\n\n", 1e-9*(double)(t1-t0),
+	 (double)restarts*(steps+1)/(1e-9*(double)(t1-t0)));
+
+  printf("rank  fitness    max bias   s0,m0,s1,m1,s2\n");
+
+  for(uint32_t i=0; i<top_len; i++) {
+    xorshift_mul_3_t* p = &top[i].p;
+    printf("%4u  %8.4f   %8.6f   %u,0x%016lx,%u,0x%016lx,%u\n",
+	   i+1, top[i].f.fitness, top[i].f.peak, p->s0, p->m0, p->s1, p->m1, p->s2);
+  }
+
+  if (known) {
+    printf("\nbuilt-in (same inputs):\n");
+
+    for(uint32_t i=0; i<xorshift_mul_3_def_len; i++) {
+      fitness_t f;
+      fitness_eval(&f, xorshift_mul_3_def+i, fin, samples_fin);
+      printf("      %8.4f   %8.6f   %s\n", f.fitness, f.peak, xorshift_mul_3_def[i].name);
+    }
+  }
+
+  printf("\n");
+
+  char name[SEARCH_MAX_TOP][16];
+
+  for(uint32_t i=0; i<top_len; i++) {
+    snprintf(name[i], sizeof(name[i]), "search%02u", i+1);
+    top[i].p.name = name[i];
+    pretty_print_xorshift_mul_3(&top[i].p, 0);
+    printf("\n");
+  }
+
+  if (!out && !validate) return 0;
+
+  static char temp[] = "/tmp/search_XXXXXX";
+
+  if (!out) {
+    int fd = mkstemp(temp);
+    if (fd < 0) { print_error("couldn't create temp file"); return -1; }
+    close(fd);
+    out = temp;
+  }
+
+  FILE* file = fopen(out, "w");
+
+  if (!file) {
+    fprintf(stderr, "error: couldn't open '%s'\n", out);
+    return -1;
+  }
+
+  fprintf(file, "# search: seed 0x%016lx, fitness on %u inputs\n", seed, samples_fin);
+
+  for(uint32_t i=0; i<top_len; i++) {
+    xorshift_mul_3_t* p = &top[i].p;
+    fprintf(file, "%u,0x%016lx,%u,0x%016lx,%u   # %f\n", p->s0, p->m0, p->s1, p->m1, p->s2, top[i].f.fitness);
+  }
+
+  fclose(file);
+
+  if (!validate) return 0;
+
+  // mini_testu01 from the same directory as this program
+  char   cmd[4096];
+  char*  slash = strrchr(argv[0], '/');
+  int    dlen  = slash ? (int)(slash-argv[0]) : 1;
+  char*  dir   = slash ? argv[0] : ".";
+
+  snprintf(cmd, sizeof(cmd), "%.*s/mini_testu01 --tournament=%s %s", dlen, dir, out, vargs);
+
+  printf("validate: %s\n\n", cmd);
+  fflush(stdout);
+
+  // its exit code (the raw wait status would truncate to zero)
+  int status = system(cmd);
+
+  return (status != -1 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+}